@@ -0,0 +1,310 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <serde/serde_all.h>
+
+/// Count heap allocations of the whole process
+static std::atomic<std::size_t> allocations{0};
+
+void *operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+/// Payloads
+
+struct Small {
+  int id;
+  std::string name;
+  bool active;
+  double score;
+
+  SERDE_DEFINE(id, name, active, score)
+};
+
+struct Wide {
+  int i00, i01, i02, i03, i04, i05, i06, i07, i08, i09;
+  int i10, i11, i12, i13, i14, i15, i16, i17, i18, i19;
+  double d00, d01, d02, d03, d04, d05, d06, d07, d08, d09;
+  std::string s00, s01, s02, s03, s04, s05, s06, s07, s08, s09;
+
+  SERDE_DEFINE(i00, i01, i02, i03, i04, i05, i06, i07, i08, i09, i10, i11, i12,
+               i13, i14, i15, i16, i17, i18, i19, d00, d01, d02, d03, d04,
+               d05, d06, d07, d08, d09, s00, s01, s02, s03, s04, s05, s06,
+               s07, s08, s09)
+};
+
+template <int D> struct Nested {
+  int value;
+  std::string tag;
+  Nested<D - 1> child;
+
+  SERDE_DEFINE(value, tag, child)
+};
+
+template <> struct Nested<0> {
+  int value;
+  std::string tag;
+
+  SERDE_DEFINE(value, tag)
+};
+
+struct LargeArray {
+  std::vector<double> values;
+
+  SERDE_DEFINE(values)
+};
+
+struct Strings {
+  std::vector<std::string> lines;
+
+  SERDE_DEFINE(lines)
+};
+
+/// Deterministic payload contents
+
+static std::string text(std::size_t n, std::size_t seed) {
+  static const char alphabet[] =
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 ";
+  std::string s;
+  s.reserve(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    s += alphabet[(i * 31 + seed * 17) % (sizeof(alphabet) - 1)];
+  }
+  return s;
+}
+
+template <typename T> T make_payload();
+
+template <> Small make_payload<Small>() {
+  return Small{42, "small payload", true, 3.25};
+}
+
+template <> Wide make_payload<Wide>() {
+  Wide w;
+  int i = 0;
+  for (auto *p : {&w.i00, &w.i01, &w.i02, &w.i03, &w.i04, &w.i05, &w.i06,
+                  &w.i07, &w.i08, &w.i09, &w.i10, &w.i11, &w.i12, &w.i13,
+                  &w.i14, &w.i15, &w.i16, &w.i17, &w.i18, &w.i19}) {
+    *p = i++ * 1000;
+  }
+  for (auto *p : {&w.d00, &w.d01, &w.d02, &w.d03, &w.d04, &w.d05, &w.d06,
+                  &w.d07, &w.d08, &w.d09}) {
+    *p = i++ * 0.125;
+  }
+  for (auto *p : {&w.s00, &w.s01, &w.s02, &w.s03, &w.s04, &w.s05, &w.s06,
+                  &w.s07, &w.s08, &w.s09}) {
+    *p = text(16, i++);
+  }
+  return w;
+}
+
+template <int D> Nested<D> make_nested() {
+  if constexpr (D == 0) {
+    return Nested<0>{D, "leaf"};
+  } else {
+    return Nested<D>{D, "node", make_nested<D - 1>()};
+  }
+}
+
+template <> Nested<16> make_payload<Nested<16>>() { return make_nested<16>(); }
+
+template <> LargeArray make_payload<LargeArray>() {
+  LargeArray a;
+  a.values.reserve(100000);
+  for (std::size_t i = 0; i < 100000; ++i) {
+    a.values.push_back(static_cast<double>(i) * 1.5 - 20000.25);
+  }
+  return a;
+}
+
+template <> Strings make_payload<Strings>() {
+  Strings s;
+  for (std::size_t i = 0; i < 1000; ++i) {
+    // Quotes, backslashes and non-ASCII exercise escaping
+    s.lines.push_back(text(64 + i % 192, i) + " \"q\" \\ \xc3\xa9");
+  }
+  return s;
+}
+
+/// Benchmarks
+///
+/// Every benchmark reports the encoded size of the payload as bytes processed
+/// and one item per message, so MB/s and msgs/s are comparable across
+/// operations.
+
+template <typename Lang, typename T> std::string encoded() {
+  return serde::to_string<Lang>(make_payload<T>()).value();
+}
+
+static void report(benchmark::State &state, std::size_t bytes,
+                   std::size_t allocs) {
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() *
+                                                    bytes));
+  state.SetItemsProcessed(state.iterations());
+  state.counters["allocs/op"] = benchmark::Counter(
+      static_cast<double>(allocs), benchmark::Counter::kAvgIterations);
+}
+
+template <typename Lang, typename T> void pack(benchmark::State &state) {
+  const auto obj = make_payload<T>();
+  const auto bytes = encoded<Lang, T>().size();
+  const auto before = allocations.load();
+  for (auto _ : state) {
+    auto node = serde::Core::pack<Lang>(obj);
+    benchmark::DoNotOptimize(node);
+  }
+  report(state, bytes, allocations.load() - before);
+}
+
+template <typename Lang, typename T> void unpack(benchmark::State &state) {
+  const auto str = encoded<Lang, T>();
+  const auto node = serde::Core::from_string<Lang>(str);
+  const auto before = allocations.load();
+  for (auto _ : state) {
+    auto obj = serde::Core::unpack<Lang, T>(node);
+    benchmark::DoNotOptimize(obj);
+  }
+  report(state, str.size(), allocations.load() - before);
+}
+
+template <typename Lang, typename T> void to_string(benchmark::State &state) {
+  const auto obj = make_payload<T>();
+  const auto bytes = encoded<Lang, T>().size();
+  const auto before = allocations.load();
+  for (auto _ : state) {
+    auto str = serde::to_string<Lang>(obj);
+    if (!str) {
+      state.SkipWithError(str.error().c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(str);
+  }
+  report(state, bytes, allocations.load() - before);
+}
+
+template <typename Lang, typename T>
+void from_string(benchmark::State &state) {
+  const auto str = encoded<Lang, T>();
+  const auto before = allocations.load();
+  for (auto _ : state) {
+    auto obj = serde::from_string<Lang, T>(str);
+    if (!obj) {
+      state.SkipWithError(obj.error().c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(obj);
+  }
+  report(state, str.size(), allocations.load() - before);
+}
+
+/// A stream of many small records, e.g. a log in NDJSON
+template <typename Lang> void records(benchmark::State &state) {
+  std::string str;
+  for (int i = 0; i < 1000; ++i) {
+    auto rec = make_payload<Small>();
+    rec.id = i;
+    serde::to_buffer<Lang>(rec, str);
+    str += '\n';
+  }
+  const auto before = allocations.load();
+  for (auto _ : state) {
+    std::int64_t sum = 0;
+    auto n = serde::records_from_bytes<Lang, Small>(
+        str, [&](Small &rec) { sum += rec.id; });
+    if (!n) {
+      state.SkipWithError(n.error().c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() *
+                                                    str.size()));
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * 1000));
+  state.counters["allocs/op"] = benchmark::Counter(
+      static_cast<double>(allocations.load() - before),
+      benchmark::Counter::kAvgIterations);
+}
+
+/// A large stream of records decoded into a vector on `state.range(0)`
+/// threads, e.g. loading a snapshot
+template <typename Lang> void parallel_records(benchmark::State &state) {
+  const int n = 100000;
+  std::string str;
+  for (int i = 0; i < n; ++i) {
+    auto rec = make_payload<Small>();
+    rec.id = i;
+    serde::to_buffer<Lang>(rec, str);
+    str += '\n';
+  }
+  serde::ParallelOptions options;
+  options.threads = static_cast<std::size_t>(state.range(0));
+  for (auto _ : state) {
+    auto v = serde::parallel_records_from_bytes<Lang, Small>(
+        str, serde::Framing::Concatenated, options);
+    if (!v) {
+      state.SkipWithError(v.error().c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(v.value().data());
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() *
+                                                    str.size()));
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * n));
+}
+
+template <typename Lang, typename T>
+void register_payload(const std::string &lang, const std::string &payload) {
+  const auto name = [&](const char *op) {
+    return lang + "/" + payload + "/" + op;
+  };
+  benchmark::RegisterBenchmark(name("pack").c_str(), pack<Lang, T>);
+  benchmark::RegisterBenchmark(name("unpack").c_str(), unpack<Lang, T>);
+  benchmark::RegisterBenchmark(name("to_string").c_str(), to_string<Lang, T>);
+  benchmark::RegisterBenchmark(name("from_string").c_str(),
+                               from_string<Lang, T>);
+}
+
+template <typename Lang> void register_lang(const std::string &lang) {
+  register_payload<Lang, Small>(lang, "small");
+  register_payload<Lang, Wide>(lang, "wide");
+  register_payload<Lang, Nested<16>>(lang, "nested");
+  register_payload<Lang, LargeArray>(lang, "large_array");
+  register_payload<Lang, Strings>(lang, "strings");
+}
+
+int main(int argc, char **argv) {
+  register_lang<serde::JSON>("json");
+  register_lang<serde::YAML>("yaml");
+  register_lang<serde::TOML>("toml");
+  register_lang<serde::CBOR>("cbor");
+  register_lang<serde::MsgPack>("msgpack");
+  register_lang<serde::UBJSON>("ubjson");
+
+  benchmark::RegisterBenchmark("json/records/ndjson", records<serde::JSON>);
+  benchmark::RegisterBenchmark("json/records/parallel",
+                               parallel_records<serde::JSON>)
+      ->RangeMultiplier(2)
+      ->Range(1, 8)
+      ->UseRealTime();
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
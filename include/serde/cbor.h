@@ -1,6 +1,8 @@
 #ifndef SERDE_CBOR_H_
 #define SERDE_CBOR_H_
 
+#include <cmath>
+
 #include <serde/json.h>
 
 namespace serde {
@@ -8,19 +10,623 @@ struct CBOR;
 
 template <> struct Node<CBOR> { json j; };
 
+/// Pull reader decoding CBOR straight into objects
+///
+/// Tags are skipped, so tagged items read as their content, except for the
+/// typed arrays of RFC 8746 read into vectors and arrays of numbers.
+class CborReader : public StreamReader {
+public:
+  using StreamReader::StreamReader;
+
+  /// Kind of the next item, looking past its tags without consuming them so
+  /// that `read_bulk` still sees the tag of a typed array
+  StreamToken peek() {
+    const auto begin = m_cur;
+    skip_tags();
+    const auto token = peek_untagged();
+    m_cur = begin;
+    return token;
+  }
+
+  bool read_null() {
+    skip_tags();
+    if (m_cur == m_end || (byte() != 0xf6 && byte() != 0xf7)) {
+      return fail("Expected null");
+    }
+    ++m_cur;
+    return true;
+  }
+
+  bool read_bool(bool &v) {
+    skip_tags();
+    if (m_cur == m_end || (byte() != 0xf4 && byte() != 0xf5)) {
+      return fail("Expected boolean");
+    }
+    v = byte() == 0xf5;
+    ++m_cur;
+    return true;
+  }
+
+  template <typename I> bool read_integer(I &v) {
+    StreamInteger n;
+    if (!read_int(n)) {
+      return false;
+    }
+    return internal::fit_integer(n, v) || fail("Integer out of range");
+  }
+
+  template <typename F> bool read_float(F &v) {
+    skip_tags();
+    if (peek() == StreamToken::Integer) {
+      StreamInteger n;
+      if (!read_int(n)) {
+        return false;
+      }
+      v = internal::to_float<F>(n);
+      return true;
+    }
+    if (m_cur == m_end) {
+      return fail("Expected number");
+    }
+    const auto b = byte();
+    if (b == 0xf9 && need(3)) {
+      v = static_cast<F>(
+          decode_half(internal::load_be<std::uint16_t>(m_cur + 1)));
+      m_cur += 3;
+      return true;
+    }
+    if (b == 0xfa && need(5)) {
+      v = static_cast<F>(internal::bit_cast<float>(
+          internal::load_be<std::uint32_t>(m_cur + 1)));
+      m_cur += 5;
+      return true;
+    }
+    if (b == 0xfb && need(9)) {
+      v = static_cast<F>(internal::bit_cast<double>(
+          internal::load_be<std::uint64_t>(m_cur + 1)));
+      m_cur += 9;
+      return true;
+    }
+    return fail("Expected number");
+  }
+
+  bool read_string(std::string &v) {
+    std::string_view view;
+    if (!read_text(view, v)) {
+      return false;
+    }
+    if (view.data() != v.data()) {
+      v.assign(view.data(), view.size());
+    }
+    return true;
+  }
+
+  bool view_string(std::string_view &v) {
+    const auto begin = m_cur;
+    if (!read_text(v, m_key)) {
+      return false;
+    }
+    if (v.data() == m_key.data()) {
+      m_cur = begin;
+      return fail("Can't borrow chunked string");
+    }
+    return true;
+  }
+
+  bool begin_array(StreamFrame &frame) { return begin(frame, 4); }
+
+  bool next_element(StreamFrame &frame) { return next(frame); }
+
+  bool begin_object(StreamFrame &frame) { return begin(frame, 5); }
+
+  bool next_key(StreamFrame &frame, std::string_view &key) {
+    return next(frame) && read_text(key, m_key);
+  }
+
+  /// Next member keyed by name, or by integer id setting `id`
+  ///
+  /// An integer that can't be an id, e.g. a negative one, is read as its
+  /// decimal text so that it matches no member.
+  bool next_key_id(StreamFrame &frame, std::string_view &key,
+                   std::optional<std::size_t> &id) {
+    if (!next(frame)) {
+      return false;
+    }
+    id.reset();
+    if (peek() != StreamToken::Integer) {
+      return read_text(key, m_key);
+    }
+    skip_tags();
+    Head h;
+    if (!read_head(h)) {
+      return false;
+    }
+    if (std::size_t v;
+        h.major == 0 && internal::fit_integer(StreamInteger{h.arg, false}, v)) {
+      id = v;
+      return true;
+    }
+    // A negative integer is -1 - arg, which may not fit in 64 bits
+    if (h.major == 0) {
+      m_key = std::to_string(h.arg);
+    } else if (h.arg == std::numeric_limits<std::uint64_t>::max()) {
+      m_key = "-18446744073709551616";
+    } else {
+      m_key = '-' + std::to_string(h.arg + 1);
+    }
+    key = m_key;
+    return true;
+  }
+
+  /// Skip a value using the lengths in the heads
+  bool skip() {
+    static constexpr auto indefinite =
+        std::numeric_limits<std::uint64_t>::max();
+
+    m_stack.clear();
+    do {
+      if (!m_stack.empty()) {
+        auto &top = m_stack.back();
+        if (top == indefinite) {
+          if (m_cur != m_end && byte() == 0xff) {
+            ++m_cur;
+            m_stack.pop_back();
+            pop_finished();
+            continue;
+          }
+        } else {
+          --top;
+        }
+      }
+
+      skip_tags();
+      Head h;
+      if (!read_head(h)) {
+        return false;
+      }
+      switch (h.major) {
+      case 2:
+      case 3:
+        if (h.indefinite) {
+          m_stack.push_back(indefinite);
+        } else if (!advance(h.arg)) {
+          return false;
+        }
+        break;
+      case 4:
+      case 5:
+        if (h.indefinite) {
+          m_stack.push_back(indefinite);
+        } else if (h.arg != 0) {
+          if (h.arg > remaining()) {
+            return fail("Container too large");
+          }
+          m_stack.push_back(h.major == 4 ? h.arg : 2 * h.arg);
+        }
+        break;
+      case 7:
+        if (h.indefinite) {
+          return fail("Unexpected break");
+        }
+        break;
+      default:
+        break;
+      }
+      pop_finished();
+    } while (!m_stack.empty());
+
+    return true;
+  }
+
+  bool finish() {
+    if (failed()) {
+      return false;
+    }
+    return m_cur == m_end || fail("Unexpected trailing bytes");
+  }
+
+  /// View the elements of a typed array in place
+  bool read_bulk(internal::TypedArray &type, std::string_view &bytes) {
+    if (m_cur == m_end || (byte() >> 5) != 6) {
+      return false;
+    }
+    const auto begin = m_cur;
+    Head tag;
+    Head h;
+    if (!read_head(tag)) {
+      return false;
+    }
+    if (!internal::typed_array_of_tag(tag.arg, type)) {
+      m_cur = begin;
+      return false;
+    }
+    if (!read_head(h)) {
+      return false;
+    }
+    if (h.major != 2 || h.indefinite) {
+      m_cur = begin;
+      return false;
+    }
+    if (!need(h.arg)) {
+      return false;
+    }
+    bytes = std::string_view(m_cur, h.arg);
+    m_cur += h.arg;
+    return true;
+  }
+
+  /// Decode a value of a type without stream support through the json tree
+  template <typename T> bool fallback(T &v) {
+    const auto begin = m_cur;
+    if (!skip()) {
+      return false;
+    }
+    const auto end = m_cur;
+    m_cur = begin;
+    const Node<JSON> node{json::from_cbor(begin, end, true, false,
+                                          json::cbor_tag_handler_t::ignore)};
+    if (node.j.is_discarded() || !unpack_node(node, v)) {
+      return fail("Bad value");
+    }
+    m_cur = end;
+    return true;
+  }
+
+private:
+  struct Head {
+    unsigned major;
+    std::uint64_t arg;
+    bool indefinite;
+  };
+
+  unsigned char byte() const { return static_cast<unsigned char>(*m_cur); }
+
+  bool need(std::size_t n) {
+    return remaining() >= n || fail("Unexpected end of input");
+  }
+
+  bool advance(std::uint64_t n) {
+    if (!need(n)) {
+      return false;
+    }
+    m_cur += n;
+    return true;
+  }
+
+  /// Read the initial byte and its argument
+  bool read_head(Head &h) {
+    if (!need(1)) {
+      return false;
+    }
+    const auto b = byte();
+    const auto begin = m_cur++;
+    h.major = b >> 5;
+    h.indefinite = false;
+
+    const auto info = b & 0x1f;
+    if (info < 24) {
+      h.arg = info;
+      return true;
+    }
+    switch (info) {
+    case 24:
+      return load<std::uint8_t>(h.arg, begin);
+    case 25:
+      return load<std::uint16_t>(h.arg, begin);
+    case 26:
+      return load<std::uint32_t>(h.arg, begin);
+    case 27:
+      return load<std::uint64_t>(h.arg, begin);
+    case 31:
+      if (h.major >= 2 && h.major != 6) {
+        h.indefinite = true;
+        h.arg = 0;
+        return true;
+      }
+      break;
+    default:
+      break;
+    }
+    m_cur = begin;
+    return fail("Bad initial byte");
+  }
+
+  template <typename T> bool load(std::uint64_t &v, const char *begin) {
+    if (remaining() < sizeof(T)) {
+      m_cur = begin;
+      return fail("Unexpected end of input");
+    }
+    v = internal::load_be<T>(m_cur);
+    m_cur += sizeof(T);
+    return true;
+  }
+
+  StreamToken peek_untagged() {
+    if (m_cur == m_end) {
+      return StreamToken::End;
+    }
+    switch (byte() >> 5) {
+    case 0:
+    case 1:
+      return StreamToken::Integer;
+    case 2:
+      return StreamToken::Binary;
+    case 3:
+      return StreamToken::String;
+    case 4:
+      return StreamToken::Array;
+    case 5:
+      return StreamToken::Object;
+    default:
+      break;
+    }
+    switch (byte()) {
+    case 0xf4:
+    case 0xf5:
+      return StreamToken::Bool;
+    case 0xf6:
+    case 0xf7:
+      return StreamToken::Null;
+    case 0xf9:
+    case 0xfa:
+    case 0xfb:
+      return StreamToken::Float;
+    default:
+      return StreamToken::Invalid;
+    }
+  }
+
+  void skip_tags() {
+    while (m_cur != m_end && (byte() >> 5) == 6) {
+      Head h;
+      if (!read_head(h)) {
+        return;
+      }
+    }
+  }
+
+  void pop_finished() {
+    while (!m_stack.empty() && m_stack.back() == 0) {
+      m_stack.pop_back();
+    }
+  }
+
+  bool read_int(StreamInteger &n) {
+    skip_tags();
+    const auto begin = m_cur;
+    Head h;
+    if (!read_head(h)) {
+      return false;
+    }
+    if (h.major == 0) {
+      n = StreamInteger{h.arg, false};
+      return true;
+    }
+    if (h.major == 1) {
+      if (h.arg > static_cast<std::uint64_t>(
+                      std::numeric_limits<std::int64_t>::max())) {
+        m_cur = begin;
+        return fail("Integer out of range");
+      }
+      n = StreamInteger{static_cast<std::uint64_t>(
+                            -1 - static_cast<std::int64_t>(h.arg)),
+                        true};
+      return true;
+    }
+    m_cur = begin;
+    return fail("Expected integer");
+  }
+
+  /// Read a text string, in place when it is in a single chunk
+  bool read_text(std::string_view &v, std::string &scratch) {
+    skip_tags();
+    const auto begin = m_cur;
+    Head h;
+    if (!read_head(h)) {
+      return false;
+    }
+    if (h.major != 3) {
+      m_cur = begin;
+      return fail("Expected string");
+    }
+    if (!h.indefinite) {
+      if (!need(h.arg)) {
+        return false;
+      }
+      v = std::string_view(m_cur, h.arg);
+      m_cur += h.arg;
+      return true;
+    }
+
+    scratch.clear();
+    for (;;) {
+      if (!need(1)) {
+        return false;
+      }
+      if (byte() == 0xff) {
+        ++m_cur;
+        v = scratch;
+        return true;
+      }
+      Head chunk;
+      if (!read_head(chunk)) {
+        return false;
+      }
+      if (chunk.major != 3 || chunk.indefinite || !need(chunk.arg)) {
+        return fail("Bad string chunk");
+      }
+      scratch.append(m_cur, chunk.arg);
+      m_cur += chunk.arg;
+    }
+  }
+
+  bool begin(StreamFrame &frame, unsigned major) {
+    skip_tags();
+    const auto begin = m_cur;
+    Head h;
+    if (!read_head(h)) {
+      return false;
+    }
+    if (h.major != major) {
+      m_cur = begin;
+      return fail(major == 4 ? "Expected array" : "Expected map");
+    }
+    frame = StreamFrame{};
+    frame.sized = !h.indefinite;
+    frame.size = h.arg;
+    return true;
+  }
+
+  bool next(StreamFrame &frame) {
+    if (frame.sized) {
+      if (frame.size == 0) {
+        return false;
+      }
+      --frame.size;
+      return true;
+    }
+    if (!need(1)) {
+      return false;
+    }
+    if (byte() == 0xff) {
+      ++m_cur;
+      return false;
+    }
+    return true;
+  }
+
+  static double decode_half(std::uint16_t half) {
+    const int exp = (half >> 10) & 0x1f;
+    const int mant = half & 0x3ff;
+    double v;
+    if (exp == 0) {
+      v = std::ldexp(mant, -24);
+    } else if (exp != 31) {
+      v = std::ldexp(mant + 1024, exp - 25);
+    } else {
+      v = mant == 0 ? std::numeric_limits<double>::infinity()
+                    : std::numeric_limits<double>::quiet_NaN();
+    }
+    return half & 0x8000 ? -v : v;
+  }
+
+  std::string m_key;
+  std::vector<std::uint64_t> m_stack;
+};
+
+/// Writer emitting CBOR straight from objects
+class CborWriter : public StreamWriter {
+public:
+  using StreamWriter::StreamWriter;
+
+  void write_null() { put(0xf6); }
+
+  void write_bool(bool v) { put(v ? 0xf5 : 0xf4); }
+
+  template <typename I> void write_integer(I v) {
+    if constexpr (std::is_signed_v<I>) {
+      if (v < 0) {
+        head(1,
+             static_cast<std::uint64_t>(-(static_cast<std::int64_t>(v) + 1)));
+        return;
+      }
+    }
+    head(0, static_cast<std::uint64_t>(v));
+  }
+
+  template <typename F> void write_float(F v) {
+    if constexpr (std::is_same_v<F, float>) {
+      put(0xfa);
+      internal::store_be(m_out, internal::bit_cast<std::uint32_t>(v));
+    } else {
+      put(0xfb);
+      internal::store_be(m_out, internal::bit_cast<std::uint64_t>(
+                                    static_cast<double>(v)));
+    }
+  }
+
+  void write_string(std::string_view v) {
+    head(3, v.size());
+    m_out.append(v.data(), v.size());
+  }
+
+  void begin_array(std::size_t n) { head(4, n); }
+
+  void end_array() {}
+
+  void begin_object(std::size_t n) { head(5, n); }
+
+  void write_key(std::string_view key) { write_string(key); }
+
+  void write_encoded_key(std::string_view bytes) { m_out += bytes; }
+
+  void write_key_id(std::size_t id) { head(0, id); }
+
+  void end_object() {}
+
+#if SERDE_TYPED_ARRAYS
+  /// Typed array in the byte order of the host
+  template <typename T> bool write_bulk(const T *data, std::size_t n) {
+    head(6, internal::typed_array_tag<T>());
+    head(2, n * sizeof(T));
+    m_out.append(reinterpret_cast<const char *>(data), n * sizeof(T));
+    return true;
+  }
+#endif
+
+  /// Encode a value of a type without stream support through the json tree
+  template <typename T> void fallback(const T &v) {
+    try {
+      const json j = v;
+      json::to_cbor(j, m_out);
+    } catch (std::exception &e) {
+      fail_copy("Bad value", e.what());
+    }
+  }
+
+private:
+  void put(std::size_t b) { m_out += static_cast<char>(b); }
+
+  void head(unsigned major, std::uint64_t arg) {
+    const auto type = major << 5;
+    if (arg < 24) {
+      put(type | arg);
+    } else if (arg <= 0xff) {
+      put(type | 24);
+      put(arg);
+    } else if (arg <= 0xffff) {
+      put(type | 25);
+      internal::store_be(m_out, static_cast<std::uint16_t>(arg));
+    } else if (arg <= 0xffffffff) {
+      put(type | 26);
+      internal::store_be(m_out, static_cast<std::uint32_t>(arg));
+    } else {
+      put(type | 27);
+      internal::store_be(m_out, arg);
+    }
+  }
+};
+
 template <> struct LangHandler<CBOR> {
+  using Reader = CborReader;
+  using Writer = CborWriter;
+
   static Node<CBOR> from_string(const std::string &str) {
-    return Node<CBOR>{json::from_cbor(str)};
+    return from_bytes(str);
+  }
+
+  static Node<CBOR> from_bytes(std::string_view bytes) {
+    return Node<CBOR>{json::from_cbor(bytes.begin(), bytes.end())};
   }
 
   static std::string to_string(const Node<CBOR> &node) {
-    auto vec = nlohmann::json::to_cbor(node.j);
-    return std::string(vec.begin(), vec.end());
+    std::string str;
+    json::to_cbor(node.j, str);
+    return str;
   }
 
   template <typename T> static T unpack(const Node<CBOR> &node) {
-    auto jnode = Node<JSON>{node.j};
-    return LangHandler<JSON>::template unpack<T>(jnode);
+    return node.j.get<T>();
   }
 
   template <typename T> static Node<CBOR> pack(const T &obj) {
@@ -29,12 +635,21 @@ template <> struct LangHandler<CBOR> {
 
   template <typename T, typename... Args>
   static T unpack_struct(const Node<CBOR> &node, Member<Args>... args) {
-    auto jnode = Node<JSON>{node.j};
-    return LangHandler<JSON>::template unpack_struct<T>(jnode, args...);
+    return LangHandler<JSON>::template unpack_object<T>(node.j, args...);
+  }
+
+  template <typename T>
+  static bool try_unpack(const Node<CBOR> &node, T &obj, Error &err) {
+    return LangHandler<JSON>::try_unpack_value(node.j, obj, err);
+  }
+
+  template <typename T>
+  static bool try_unpack_struct(const Node<CBOR> &node, T &obj, Error &err) {
+    return LangHandler<JSON>::try_unpack_object(node.j, obj, err);
   }
 
   template <typename T, typename... Args>
-  static Node<CBOR> pack_struct(Member<Args>... args) {
+  static Node<CBOR> pack_struct(MemberRef<const Args>... args) {
     return Node<CBOR>{LangHandler<JSON>::template pack_struct<T>(args...).j};
   }
 };
@@ -1,8 +1,14 @@
 #ifndef SERDE_JSON_H_
 #define SERDE_JSON_H_
 
+#include <charconv>
+#include <cmath>
+
 #include <nlohmann/json.hpp>
 
+#include <serde/simd.h>
+#include <serde/stream.h>
+
 namespace serde {
 
 struct JSON;
@@ -13,6 +19,8 @@ using json =
     nlohmann::basic_json<std::map, std::vector, std::string, bool, std::int64_t,
                          std::uint64_t, double, std::allocator, JsonSerde>;
 
+template <> struct Node<JSON> { json j; };
+
 template <typename T, typename> struct JsonSerde {
   static void from_json(const json &j, T &t) {
     if constexpr (is_serde_compatible_v<T>) {
@@ -51,9 +59,57 @@ template <typename T, typename U> struct JsonSerde<std::optional<T>, U> {
   }
 };
 
+/// View of a json value for internal::probe
+struct JsonProbe {
+  const json &j;
+
+  bool is_null() const { return j.is_null(); }
+
+  template <typename T> bool is() const {
+    if constexpr (std::is_same_v<T, bool>) {
+      return j.is_boolean();
+    } else if constexpr (std::is_arithmetic_v<T>) {
+      // nlohmann converts booleans to numbers
+      return j.is_number() || j.is_boolean();
+    } else {
+      return j.is_string();
+    }
+  }
+
+  bool string(std::string_view &s) const {
+    if (!j.is_string()) {
+      return false;
+    }
+    s = j.get_ref<const std::string &>();
+    return true;
+  }
+
+  bool is_array() const { return j.is_array(); }
+  std::size_t size() const { return j.size(); }
+  JsonProbe at(std::size_t i) const { return JsonProbe{j[i]}; }
+
+  template <typename F> bool all_elements(F f) const {
+    return std::all_of(j.begin(), j.end(),
+                       [&](const json &e) { return f(JsonProbe{e}); });
+  }
+
+  bool is_object() const { return j.is_object(); }
+
+  template <typename F> bool all_members(F f) const {
+    for (auto it = j.begin(); it != j.end(); ++it) {
+      if (!f(std::string_view(it.key()), JsonProbe{it.value()})) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
 /// Helper method for std::variant converter
+///
+/// Alternatives the probe rules out are skipped without throwing.
 template <typename T, typename U> void try_set(const json &j, U &t, bool &set) {
-  if (set) {
+  if (set || !internal::probe<T>(JsonProbe{j})) {
     return;
   }
   try {
@@ -65,26 +121,808 @@ template <typename T, typename U> void try_set(const json &j, U &t, bool &set) {
 }
 
 template <typename... T, typename U> struct JsonSerde<std::variant<T...>, U> {
-  static void from_json(const json &j, std::variant<T...> &t) {
-    bool set = false;
+  using V = std::variant<T...>;
 
-    (try_set<T>(j, t, set), ...);
+  static void from_json(const json &j, V &t) {
+    if constexpr (internal::is_tagged_variant<V>::value) {
+      from_tagged(j, t);
+    } else {
+      bool set = false;
+
+      (try_set<T>(j, t, set), ...);
 
-    if (!set) {
-      throw serde::Exception("Variant didn't match");
+      if (!set) {
+        throw serde::Exception("Variant didn't match");
+      }
     }
   }
 
-  static void to_json(json &j, const std::variant<T...> &t) {
+  static void to_json(json &j, const V &t) {
     std::visit([&](auto &v) { j = Core::pack<JSON>(v).j; }, t);
+    if constexpr (internal::is_tagged_variant<V>::value) {
+      const auto name = std::string(VariantTags<V>::names.name(t.index()));
+      if (VariantTags<V>::tag.empty()) {
+        j = json{{name, std::move(j)}};
+      } else {
+        j[std::string(VariantTags<V>::tag)] = name;
+      }
+    }
+  }
+
+private:
+  static void from_tagged(const json &j, V &t) {
+    const auto &tag = VariantTags<V>::tag;
+    if (!j.is_object() || (tag.empty() && j.size() != 1)) {
+      throw serde::Exception("Expected variant object");
+    }
+    auto it = tag.empty() ? j.begin() : j.find(std::string(tag));
+    if (it == j.end()) {
+      throw serde::Exception("Missing variant tag: " + std::string(tag));
+    }
+    const auto &name = tag.empty()
+                           ? it.key()
+                           : it.value().template get_ref<const std::string &>();
+    const auto i = VariantTags<V>::names.find(name);
+    if (i == sizeof...(T)) {
+      throw serde::Exception("Bad variant name: " + name);
+    }
+    // The tag isn't a member of the alternative
+    json value = tag.empty() ? it.value() : j;
+    if (!tag.empty()) {
+      value.erase(std::string(tag));
+    }
+    internal::with_alternative(t, i, [&](auto &alt) {
+      alt = Core::unpack<JSON, std::decay_t<decltype(alt)>>(
+          Node<JSON>{std::move(value)});
+      return true;
+    });
   }
 };
 
-template <> struct Node<JSON> { json j; };
+/// Pull reader decoding JSON text straight into objects
+class JsonReader : public StreamReader {
+public:
+  using StreamReader::StreamReader;
+
+  StreamToken peek() {
+    skip_ws();
+    if (m_cur == m_end) {
+      return StreamToken::End;
+    }
+    switch (*m_cur) {
+    case 'n':
+      return StreamToken::Null;
+    case 't':
+    case 'f':
+      return StreamToken::Bool;
+    case '"':
+      return StreamToken::String;
+    case '[':
+      return StreamToken::Array;
+    case '{':
+      return StreamToken::Object;
+    default:
+      break;
+    }
+    const auto end = number_end();
+    if (end == m_cur) {
+      return StreamToken::Invalid;
+    }
+    return std::find_if(m_cur, end, [](char c) {
+             return c == '.' || c == 'e' || c == 'E';
+           }) == end
+               ? StreamToken::Integer
+               : StreamToken::Float;
+  }
+
+  bool read_null() {
+    skip_ws();
+    return literal("null") || fail("Expected null");
+  }
+
+  bool read_bool(bool &v) {
+    skip_ws();
+    if (literal("true")) {
+      v = true;
+      return true;
+    }
+    if (literal("false")) {
+      v = false;
+      return true;
+    }
+    return fail("Expected boolean");
+  }
+
+  /// Integers may be written as floats with no fraction, e.g. `1.0` or
+  /// `1e3`, as nlohmann converts them
+  template <typename I> bool read_integer(I &v) {
+    skip_ws();
+    const auto end = number_end();
+    if (end == m_cur) {
+      return fail("Expected integer");
+    }
+    const auto [ptr, ec] = std::from_chars(m_cur, end, v);
+    if (ptr != end) {
+      double d;
+      const auto bound = std::ldexp(1.0, std::numeric_limits<I>::digits);
+      const auto lowest = std::is_signed_v<I> ? -bound : 0.0;
+      if (std::from_chars(m_cur, end, d).ptr != end || std::trunc(d) != d ||
+          d < lowest || d >= bound) {
+        return fail("Expected integer");
+      }
+      v = static_cast<I>(d);
+    } else if (ec != std::errc()) {
+      return fail("Expected integer");
+    }
+    m_cur = end;
+    return true;
+  }
+
+  template <typename F> bool read_float(F &v) {
+    skip_ws();
+    const auto end = number_end();
+    const auto [ptr, ec] = std::from_chars(m_cur, end, v);
+    if (ec != std::errc() || ptr != end) {
+      return fail("Expected number");
+    }
+    m_cur = end;
+    return true;
+  }
+
+  bool read_string(std::string &v) {
+    skip_ws();
+    if (m_cur == m_end || *m_cur != '"') {
+      return fail("Expected string");
+    }
+    ++m_cur;
+    v.clear();
+    return read_string_body(v);
+  }
+
+  bool view_string(std::string_view &v) {
+    skip_ws();
+    if (m_cur == m_end || *m_cur != '"') {
+      return fail("Expected string");
+    }
+    ++m_cur;
+    const char *p;
+    if (!string_run_end(p)) {
+      return false;
+    }
+    if (p == m_end || *p != '"') {
+      --m_cur;
+      return fail("Can't borrow escaped string");
+    }
+    v = std::string_view(m_cur, p - m_cur);
+    m_cur = p + 1;
+    return true;
+  }
+
+  bool begin_array(StreamFrame &frame) {
+    skip_ws();
+    if (m_cur == m_end || *m_cur != '[') {
+      return fail("Expected array");
+    }
+    ++m_cur;
+    frame = StreamFrame{};
+    return true;
+  }
+
+  bool next_element(StreamFrame &frame) {
+    skip_ws();
+    if (m_cur == m_end) {
+      return fail("Unterminated array");
+    }
+    if (*m_cur == ']') {
+      ++m_cur;
+      return false;
+    }
+    if (frame.first) {
+      frame.first = false;
+      return true;
+    }
+    if (*m_cur != ',') {
+      return fail("Expected ',' or ']'");
+    }
+    ++m_cur;
+    return true;
+  }
+
+  bool begin_object(StreamFrame &frame) {
+    skip_ws();
+    if (m_cur == m_end || *m_cur != '{') {
+      return fail("Expected object");
+    }
+    ++m_cur;
+    frame = StreamFrame{};
+    return true;
+  }
+
+  bool next_key(StreamFrame &frame, std::string_view &key) {
+    skip_ws();
+    if (m_cur == m_end) {
+      return fail("Unterminated object");
+    }
+    if (*m_cur == '}') {
+      ++m_cur;
+      return false;
+    }
+    if (!frame.first) {
+      if (*m_cur != ',') {
+        return fail("Expected ',' or '}'");
+      }
+      ++m_cur;
+      skip_ws();
+    }
+    frame.first = false;
+
+    if (m_cur == m_end || *m_cur != '"') {
+      return fail("Expected member name");
+    }
+    ++m_cur;
+    if (!read_key(key)) {
+      return false;
+    }
+
+    skip_ws();
+    if (m_cur == m_end || *m_cur != ':') {
+      return fail("Expected ':'");
+    }
+    ++m_cur;
+    return true;
+  }
+
+  /// Skip a value without decoding it
+  bool skip() {
+    skip_ws();
+    if (m_cur != m_end && (*m_cur == '[' || *m_cur == '{')) {
+      return skip_container();
+    }
+    return skip_scalar();
+  }
+
+  bool finish() {
+    if (failed()) {
+      return false;
+    }
+    skip_ws();
+    return m_cur == m_end || fail("Unexpected trailing characters");
+  }
+
+  /// True if only whitespace is left, e.g. between the lines of NDJSON
+  bool at_end() {
+    skip_ws();
+    return m_cur == m_end;
+  }
+
+  /// Decode a value of a type without stream support through the json tree
+  template <typename T> bool fallback(T &v) {
+    skip_ws();
+    const auto begin = m_cur;
+    if (!skip()) {
+      return false;
+    }
+    const auto end = m_cur;
+    m_cur = begin;
+    const Node<JSON> node{json::parse(begin, end, nullptr, false)};
+    if (node.j.is_discarded() || !unpack_node(node, v)) {
+      return fail("Bad value");
+    }
+    m_cur = end;
+    return true;
+  }
+
+private:
+  static bool is_number_char(char c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' ||
+           c == 'e' || c == 'E';
+  }
+
+  void skip_ws() { m_cur = internal::scan_non_ws(m_cur, m_end); }
+
+  /// End of the number at the cursor, or the cursor if there's no valid one
+  ///
+  /// Follows the grammar of JSON: no leading zeros, and digits after the
+  /// point and in the exponent. A number running into more number
+  /// characters, as in `007` or `1.`, isn't valid.
+  const char *number_end() const {
+    const auto digits = [&](const char *p) {
+      while (p != m_end && *p >= '0' && *p <= '9') {
+        ++p;
+      }
+      return p;
+    };
+    auto p = m_cur;
+    if (p != m_end && *p == '-') {
+      ++p;
+    }
+    if (p == m_end || *p < '0' || *p > '9') {
+      return m_cur;
+    }
+    p = *p == '0' ? p + 1 : digits(p);
+    if (p != m_end && *p == '.') {
+      const auto q = digits(p + 1);
+      if (q == p + 1) {
+        return m_cur;
+      }
+      p = q;
+    }
+    if (p != m_end && (*p == 'e' || *p == 'E')) {
+      ++p;
+      if (p != m_end && (*p == '+' || *p == '-')) {
+        ++p;
+      }
+      const auto q = digits(p);
+      if (q == p) {
+        return m_cur;
+      }
+      p = q;
+    }
+    return p != m_end && is_number_char(*p) ? m_cur : p;
+  }
+
+  bool literal(std::string_view lit) {
+    if (std::string_view(m_cur, std::min(remaining(), lit.size())) != lit) {
+      return false;
+    }
+    m_cur += lit.size();
+    return true;
+  }
+
+  /// Find the end of the plain run of a string: quote, backslash or control
+  /// character; fails at the first byte of the run that isn't UTF-8
+  bool string_run_end(const char *&p) {
+    bool ascii = true;
+    p = internal::scan_string(m_cur, m_end, ascii);
+    if (!ascii) {
+      const auto bad = internal::utf8_error(m_cur, p);
+      if (bad != p) {
+        m_cur = bad;
+        return fail("Invalid UTF-8 in string");
+      }
+    }
+    return true;
+  }
+
+  /// Read the rest of a string after the opening quote
+  bool read_string_body(std::string &out) {
+    for (;;) {
+      const char *p;
+      if (!string_run_end(p)) {
+        return false;
+      }
+      out.append(m_cur, p);
+      m_cur = p;
+      if (m_cur == m_end) {
+        return fail("Unterminated string");
+      }
+      if (*m_cur == '"') {
+        ++m_cur;
+        return true;
+      }
+      if (*m_cur != '\\') {
+        return fail("Control character in string");
+      }
+      if (!unescape(out)) {
+        return false;
+      }
+    }
+  }
+
+  /// Read a member name; unescaped names are viewed in place
+  bool read_key(std::string_view &key) {
+    const char *p;
+    if (!string_run_end(p)) {
+      return false;
+    }
+    if (p != m_end && *p == '"') {
+      key = std::string_view(m_cur, p - m_cur);
+      m_cur = p + 1;
+      return true;
+    }
+    m_key.clear();
+    if (!read_string_body(m_key)) {
+      return false;
+    }
+    key = m_key;
+    return true;
+  }
+
+  bool read_hex4(std::uint32_t &cp) {
+    if (remaining() < 4) {
+      return fail("Bad unicode escape");
+    }
+    cp = 0;
+    for (int i = 0; i < 4; ++i) {
+      const char c = *m_cur++;
+      cp <<= 4;
+      if (c >= '0' && c <= '9') {
+        cp |= c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        cp |= c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        cp |= c - 'A' + 10;
+      } else {
+        return fail("Bad unicode escape");
+      }
+    }
+    return true;
+  }
+
+  /// Decode an escape sequence at the cursor
+  bool unescape(std::string &out) {
+    ++m_cur;
+    if (m_cur == m_end) {
+      return fail("Unterminated string");
+    }
+    switch (*m_cur++) {
+    case '"':
+      out += '"';
+      return true;
+    case '\\':
+      out += '\\';
+      return true;
+    case '/':
+      out += '/';
+      return true;
+    case 'b':
+      out += '\b';
+      return true;
+    case 'f':
+      out += '\f';
+      return true;
+    case 'n':
+      out += '\n';
+      return true;
+    case 'r':
+      out += '\r';
+      return true;
+    case 't':
+      out += '\t';
+      return true;
+    case 'u':
+      break;
+    default:
+      return fail("Bad escape");
+    }
+
+    std::uint32_t cp;
+    if (!read_hex4(cp)) {
+      return false;
+    }
+    if (cp >= 0xd800 && cp <= 0xdbff) {
+      std::uint32_t lo;
+      if (!literal("\\u") || !read_hex4(lo) || lo < 0xdc00 || lo > 0xdfff) {
+        return fail("Bad surrogate pair");
+      }
+      cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+    } else if (cp >= 0xdc00 && cp <= 0xdfff) {
+      return fail("Bad surrogate pair");
+    }
+
+    if (cp < 0x80) {
+      out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+      out += static_cast<char>(0xc0 | (cp >> 6));
+      out += static_cast<char>(0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+      out += static_cast<char>(0xe0 | (cp >> 12));
+      out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (cp & 0x3f));
+    } else {
+      out += static_cast<char>(0xf0 | (cp >> 18));
+      out += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+      out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (cp & 0x3f));
+    }
+    return true;
+  }
+
+  /// Skip the rest of a string after the opening quote, checking it as
+  /// `read_string_body` does
+  bool skip_string() {
+    // Escapes are decoded and dropped; at 4 bytes at most they don't allocate
+    std::string escape;
+    for (;;) {
+      const char *p;
+      if (!string_run_end(p)) {
+        return false;
+      }
+      m_cur = p;
+      if (m_cur == m_end) {
+        return fail("Unterminated string");
+      }
+      if (*m_cur == '"') {
+        ++m_cur;
+        return true;
+      }
+      if (*m_cur != '\\') {
+        return fail("Control character in string");
+      }
+      escape.clear();
+      if (!unescape(escape)) {
+        return false;
+      }
+    }
+  }
+
+  /// Skip a value other than an array or object
+  bool skip_scalar() {
+    skip_ws();
+    if (m_cur == m_end) {
+      return fail("Unexpected end of input");
+    }
+    switch (*m_cur) {
+    case '"':
+      ++m_cur;
+      return skip_string();
+    case 'n':
+      return read_null();
+    case 't':
+    case 'f': {
+      bool b;
+      return read_bool(b);
+    }
+    default: {
+      const auto end = number_end();
+      if (end == m_cur) {
+        return fail("Unexpected character");
+      }
+      m_cur = end;
+      return true;
+    }
+    }
+  }
+
+  /// Skip a member name and the colon after it
+  bool skip_member_name() {
+    skip_ws();
+    if (m_cur == m_end || *m_cur != '"') {
+      return fail("Expected member name");
+    }
+    ++m_cur;
+    if (!skip_string()) {
+      return false;
+    }
+    skip_ws();
+    if (m_cur == m_end || *m_cur != ':') {
+      return fail("Expected ':'");
+    }
+    ++m_cur;
+    return true;
+  }
+
+  /// Skip an array or object, checking its structure without decoding it
+  ///
+  /// Brackets, commas and colons are checked along with the grammar of
+  /// scalars; strings and whitespace are skipped by the vector scans. Open
+  /// brackets are kept in a scratch buffer instead of recursing.
+  bool skip_container() {
+    m_open.clear();
+    for (;;) {
+      // At a value
+      skip_ws();
+      if (m_cur != m_end && (*m_cur == '[' || *m_cur == '{')) {
+        const char open = *m_cur++;
+        m_open += open;
+        skip_ws();
+        // ']' and '}' follow their opening brackets by 2
+        if (m_cur == m_end || *m_cur != open + 2) {
+          if (open == '{' && !skip_member_name()) {
+            return false;
+          }
+          continue;
+        }
+        ++m_cur;
+        m_open.pop_back();
+      } else if (!skip_scalar()) {
+        return false;
+      }
+
+      // After a value: close containers until a comma leads to the next
+      for (;;) {
+        if (m_open.empty()) {
+          return true;
+        }
+        skip_ws();
+        if (m_cur == m_end) {
+          return fail("Unterminated container");
+        }
+        const char c = *m_cur;
+        if (c == m_open.back() + 2) {
+          ++m_cur;
+          m_open.pop_back();
+          continue;
+        }
+        if (c == ']' || c == '}') {
+          return fail("Mismatched bracket");
+        }
+        if (c != ',') {
+          return fail("Expected ','");
+        }
+        ++m_cur;
+        if (m_open.back() == '{' && !skip_member_name()) {
+          return false;
+        }
+        break;
+      }
+    }
+  }
+
+  std::string m_key;
+  /// Brackets open while skipping a container
+  std::string m_open;
+};
+
+/// Writer emitting JSON text straight from objects
+class JsonWriter : public StreamWriter {
+public:
+  using StreamWriter::StreamWriter;
+
+  void write_null() {
+    separate();
+    m_out += "null";
+  }
+
+  void write_bool(bool v) {
+    separate();
+    m_out += v ? "true" : "false";
+  }
+
+  template <typename I> void write_integer(I v) {
+    separate();
+    char buf[24];
+    const auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    m_out.append(buf, res.ptr);
+  }
+
+  template <typename F> void write_float(F v) {
+    separate();
+    if (!std::isfinite(v)) {
+      // Same as json::dump
+      m_out += "null";
+      return;
+    }
+    char buf[32];
+    const auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    m_out.append(buf, res.ptr);
+    // Keep the number a float when it is read back
+    if (std::find_if(buf, res.ptr, [](char c) {
+          return c == '.' || c == 'e';
+        }) == res.ptr) {
+      m_out += ".0";
+    }
+  }
+
+  void write_string(std::string_view v) {
+    separate();
+    write_quoted(v);
+  }
+
+  void begin_array(std::size_t) {
+    separate();
+    m_out += '[';
+    m_comma = false;
+  }
+
+  void end_array() {
+    m_out += ']';
+    m_comma = true;
+  }
+
+  void begin_object(std::size_t) {
+    separate();
+    m_out += '{';
+    m_comma = false;
+  }
+
+  void write_key(std::string_view key) {
+    separate();
+    write_quoted(key);
+    m_out += ':';
+    m_comma = false;
+  }
+
+  /// Key as written by `write_key` of a fresh writer
+  void write_encoded_key(std::string_view bytes) {
+    separate();
+    m_out += bytes;
+    m_comma = false;
+  }
+
+  void end_object() {
+    m_out += '}';
+    m_comma = true;
+  }
+
+  /// Encode a value of a type without stream support through the json tree
+  template <typename T> void fallback(const T &v) {
+    try {
+      const json j = v;
+      separate();
+      m_out += j.dump();
+    } catch (std::exception &e) {
+      fail_copy("Bad value", e.what());
+    }
+  }
+
+private:
+  void separate() {
+    if (m_comma) {
+      m_out += ',';
+    }
+    m_comma = true;
+  }
+
+  void write_quoted(std::string_view v) {
+    static constexpr char hex[] = "0123456789abcdef";
+
+    m_out += '"';
+    auto p = v.data();
+    const auto end = p + v.size();
+    while (p != end) {
+      // Copy the run of characters that need no escape at once; it ends where
+      // a string being read would
+      bool ascii = true;
+      const auto q = internal::scan_string(p, end, ascii);
+      if (!ascii) {
+        if (const auto bad = internal::utf8_error(p, q); bad != q) {
+          m_out.append(p, bad);
+          fail("Invalid UTF-8 in string");
+          return;
+        }
+      }
+      m_out.append(p, q);
+      if (q == end) {
+        break;
+      }
+      const auto c = static_cast<unsigned char>(*q);
+      switch (c) {
+      case '"':
+        m_out += "\\\"";
+        break;
+      case '\\':
+        m_out += "\\\\";
+        break;
+      case '\b':
+        m_out += "\\b";
+        break;
+      case '\f':
+        m_out += "\\f";
+        break;
+      case '\n':
+        m_out += "\\n";
+        break;
+      case '\r':
+        m_out += "\\r";
+        break;
+      case '\t':
+        m_out += "\\t";
+        break;
+      default:
+        m_out += "\\u00";
+        m_out += hex[c >> 4];
+        m_out += hex[c & 0xf];
+        break;
+      }
+      p = q + 1;
+    }
+    m_out += '"';
+  }
+
+  bool m_comma = false;
+};
 
 template <> struct LangHandler<JSON> {
+  using Reader = JsonReader;
+  using Writer = JsonWriter;
+
   static Node<JSON> from_string(const std::string &str) {
-    return Node<JSON>{json::parse(str)};
+    return from_bytes(str);
+  }
+
+  static Node<JSON> from_bytes(std::string_view bytes) {
+    return Node<JSON>{json::parse(bytes.begin(), bytes.end())};
   }
 
   static std::string to_string(const Node<JSON> &node) { return node.j.dump(); }
@@ -99,17 +937,41 @@ template <> struct LangHandler<JSON> {
 
   template <typename T, typename... Args>
   static T unpack_struct(const Node<JSON> &node, Member<Args>... args) {
-    if (!node.j.is_object()) {
+    return unpack_object<T>(node.j, args...);
+  }
+
+  /// Unpack a structure from a json tree shared by the binary languages
+  template <typename T, typename... Args>
+  static T unpack_object(const json &j, Member<Args>... args) {
+    if (!j.is_object()) {
       throw Exception("Node is not object");
     }
 
-    auto unpack_member = [&](const auto &mem) {
-      if (node.j.find(mem.name) != node.j.end()) {
-        return node.j[mem.name]
-            .template get<std::decay_t<decltype(mem.value.value())>>();
+    // Match each key of the input to its member once
+    std::array<const json *, sizeof...(Args)> slots{};
+    for (auto it = j.begin(); it != j.end(); ++it) {
+      const auto i = internal::field_index_v<T>.find(it.key());
+      if (i < slots.size()) {
+        slots[i] = &it.value();
+      } else if (DenyUnknown<T>::value) {
+        throw Exception("Unknown member: " + it.key());
+      }
+    }
+
+    return unpack_slots<T>(slots, std::index_sequence_for<Args...>{},
+                           args...);
+  }
+
+  template <typename T, std::size_t... I, typename... Args>
+  static T unpack_slots(const std::array<const json *, sizeof...(Args)> &slots,
+                        std::index_sequence<I...>, Member<Args>... args) {
+    // Values and defaults are built in place of the members
+    auto unpack_member = [&](const json *v, auto &mem) {
+      if (v) {
+        return v->template get<typename std::decay_t<decltype(mem)>::type>();
       } else {
-        if (mem.value) {
-          return mem.value.value();
+        if (mem.make_default) {
+          return mem.make_default();
         } else {
           throw Exception("Node member doesn't have value: " +
                           std::string(mem.name));
@@ -117,20 +979,110 @@ template <> struct LangHandler<JSON> {
       }
     };
 
-    return T{unpack_member(args)...};
+    return T{unpack_member(slots[I], args)...};
   }
 
-  template <typename T, typename... Args>
-  static Node<JSON> pack_struct(Member<Args>... args) {
-    json j;
+  template <typename T>
+  static bool try_unpack(const Node<JSON> &node, T &obj, Error &err) {
+    return try_unpack_value(node.j, obj, err);
+  }
 
-    auto push_member = [&](auto &mem) {
-      if (!mem.value) {
-        throw Exception("Logic error: " + std::string(mem.name));
+  template <typename T>
+  static bool try_unpack_struct(const Node<JSON> &node, T &obj, Error &err) {
+    return try_unpack_object(node.j, obj, err);
+  }
+
+  /// Decode a value from a json tree without throwing for malformed input
+  ///
+  /// Structures, enums and optionals are matched here; other types are
+  /// probed first so that nlohmann only sees values it can convert.
+  template <typename T>
+  static bool try_unpack_value(const json &j, T &obj, Error &err) {
+    if constexpr (is_serde_record_v<T>) {
+      return try_unpack_object(j, obj, err);
+    } else if constexpr (std::is_enum_v<T> && is_serde_specialized_v<T>) {
+      if (!j.is_string()) {
+        return err.fail("Enum value is not string", j.type_name());
+      }
+      const auto &name = j.get_ref<const std::string &>();
+      const auto value = internal::enum_table_v<T>.value(name);
+      if (!value) {
+        return err.fail_copy("Bad enum value", name);
       }
+      obj = value.value();
+      return true;
+    } else if constexpr (internal::is_optional<T>::value) {
+      if (j.is_null()) {
+        obj.reset();
+        return true;
+      }
+      if constexpr (std::is_default_constructible_v<typename T::value_type>) {
+        return try_unpack_value(j, obj.emplace(), err);
+      } else {
+        return try_convert(j, obj, err);
+      }
+    } else {
+      return try_convert(j, obj, err);
+    }
+  }
 
-      j[mem.name] = mem.value.value();
-    };
+  /// Convert through nlohmann if the probe doesn't rule the value out
+  template <typename T>
+  static bool try_convert(const json &j, T &obj, Error &err) {
+    if (!internal::probe<T>(JsonProbe{j})) {
+      return err.fail("Unexpected node type");
+    }
+    try {
+      j.get_to(obj);
+      return true;
+    } catch (std::exception &e) {
+      return err.fail_copy("Bad value", e.what());
+    }
+  }
+
+  /// Decode a structure in place from a json tree without throwing
+  template <typename T>
+  static bool try_unpack_object(const json &j, T &obj, Error &err) {
+    if (!j.is_object()) {
+      return err.fail("Node is not object", j.type_name());
+    }
+
+    auto members = CoreHandler<T>::fields(obj);
+    std::array<const json *, std::tuple_size_v<decltype(members)>> slots{};
+    for (auto it = j.begin(); it != j.end(); ++it) {
+      const auto i = internal::field_index_v<T>.find(it.key());
+      if (i < slots.size()) {
+        slots[i] = &it.value();
+      } else if (DenyUnknown<T>::value) {
+        return err.fail_copy("Unknown member", it.key());
+      }
+    }
+
+    return !internal::any_member(members, [&](auto &mem, auto i) {
+      if (slots[i]) {
+        if (try_unpack_value(*slots[i], mem.value, err)) {
+          return false;
+        }
+        // Name the innermost member that failed
+        if (err.detail().empty()) {
+          err.set(err.reason(), err.offset(), mem.name);
+        }
+        return true;
+      }
+      if constexpr (std::decay_t<decltype(mem)>::has_default) {
+        mem.value = mem.make_default();
+        return false;
+      } else {
+        return !err.fail("Node member doesn't have value", mem.name);
+      }
+    });
+  }
+
+  template <typename T, typename... Args>
+  static Node<JSON> pack_struct(MemberRef<const Args>... args) {
+    json j;
+
+    auto push_member = [&](auto &mem) { j[mem.name] = mem.value; };
 
     (push_member(args), ...);
 
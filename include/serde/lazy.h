@@ -0,0 +1,224 @@
+#ifndef SERDE_LAZY_H_
+#define SERDE_LAZY_H_
+
+#include <deque>
+#include <functional>
+#include <memory>
+
+#include <serde/stream.h>
+
+namespace serde {
+
+/// View of an encoded value that decodes only what is asked for
+///
+/// Looking up a member or an element indexes the members or elements of the
+/// value once, skipping over their contents, and returns a view of the one
+/// found; `as<T>()` then decodes that value alone:
+///
+///   serde::LazyView<serde::JSON> msg(bytes);
+///   auto route = msg["header"]["route"].as<std::string>();
+///   if (!route) {
+///     ... route.error() ...
+///   }
+///
+/// Lookups through a missing member or a malformed value yield an empty view
+/// whose `as<T>()` reports why. Keep the view of a value looked into several
+/// times, e.g. `auto header = msg["header"];`, as its copies share its index.
+/// The input must outlive the views, which aren't safe to look into from
+/// several threads at once. Elements of UBJSON containers with a type have no
+/// marker and can't be viewed.
+template <typename Lang> class LazyView {
+  using Reader = typename LangHandler<Lang>::Reader;
+
+public:
+  /// View of a whole document
+  explicit LazyView(std::string_view input)
+      : m_input(input), m_begin(0), m_end(input.size()) {}
+
+  /// True unless a lookup on the way to the value failed
+  explicit operator bool() const { return !m_error; }
+
+  /// Why the view is empty
+  const Error &error() const { return m_error; }
+
+  /// Encoded bytes of the value
+  std::string_view bytes() const {
+    return m_input.substr(m_begin, m_end - m_begin);
+  }
+
+  /// Kind of the value
+  StreamToken type() const {
+    if (m_error) {
+      return StreamToken::Invalid;
+    }
+    return reader().peek();
+  }
+
+  /// Number of members of an object or elements of an array, else 0
+  std::size_t size() const { return index() ? m_index->entries.size() : 0; }
+
+  /// View of the member named `key`, the last one if repeated
+  LazyView operator[](std::string_view key) const {
+    if (!index()) {
+      return failed();
+    }
+    if (m_index->token == StreamToken::Object) {
+      const auto &entries = m_index->entries;
+      for (auto i = entries.size(); i-- != 0;) {
+        if (entries[i].key == key) {
+          return at_entry(i);
+        }
+      }
+    }
+    Error err;
+    err.set_copy(m_index->token == StreamToken::Object
+                     ? "Node member doesn't have value"
+                     : "Expected object",
+                 m_begin, std::string(key));
+    return failed(std::move(err));
+  }
+
+  /// View of the i-th element of an array or member of an object
+  LazyView operator[](std::size_t i) const {
+    if (!index()) {
+      return failed();
+    }
+    if (i >= m_index->entries.size()) {
+      Error err;
+      err.set_copy("Index out of range", m_begin, std::to_string(i));
+      return failed(std::move(err));
+    }
+    return at_entry(i);
+  }
+
+  /// Name of the i-th member of an object
+  std::string_view key(std::size_t i) const {
+    return index() && i < m_index->entries.size() ? m_index->entries[i].key
+                                                   : std::string_view();
+  }
+
+  /// Decode the value alone
+  template <typename T> Result<T> as() const {
+    static_assert(internal::has_reader<Lang, T>::value,
+                  "Lazy views decode default constructible types");
+    auto err = m_error;
+    if (!err) {
+      auto r = reader();
+      T obj{};
+      if (StreamSerde<T>::read(r, obj) && r.finish()) {
+        return Result<T>::value(std::move(obj));
+      }
+      err = r.error();
+    }
+    err.context("parsing view");
+    return Result<T>::error(std::move(err));
+  }
+
+  /// Decode the member named `key` alone
+  template <typename T> Result<T> get(std::string_view key) const {
+    return (*this)[key].template as<T>();
+  }
+
+private:
+  struct Entry {
+    std::string_view key;
+    std::size_t begin;
+    std::size_t end;
+  };
+
+  /// Members or elements of a value, found by skipping over them
+  struct Index {
+    StreamToken token = StreamToken::Invalid;
+    std::vector<Entry> entries;
+    /// Names that aren't stored verbatim in the input
+    std::deque<std::string> keys;
+    Error error;
+  };
+
+  Reader reader() const {
+    Reader r(m_input);
+    r.narrow(m_begin, m_end);
+    return r;
+  }
+
+  /// Index the value on first use; false if the view or the value is bad
+  bool index() const {
+    if (m_error) {
+      return false;
+    }
+    if (!m_index) {
+      m_index = std::make_shared<Index>();
+      build(*m_index);
+    }
+    return !m_index->error;
+  }
+
+  void build(Index &index) const {
+    auto r = reader();
+    index.token = r.peek();
+    StreamFrame frame;
+    std::string_view key;
+    const auto add = [&](std::string_view name) {
+      // Values start after their padding, if any
+      r.peek();
+      const auto begin = r.offset();
+      if (!r.skip()) {
+        return false;
+      }
+      index.entries.push_back(Entry{name, begin, r.offset()});
+      return true;
+    };
+
+    if (index.token == StreamToken::Object && r.begin_object(frame)) {
+      while (r.next_key(frame, key)) {
+        const std::less<const char *> less;
+        if (less(key.data(), m_input.data()) ||
+            !less(key.data(), m_input.data() + m_input.size())) {
+          key = index.keys.emplace_back(key);
+        }
+        if (!add(key)) {
+          break;
+        }
+      }
+    } else if (index.token == StreamToken::Array && r.begin_array(frame)) {
+      while (r.next_element(frame) && add({})) {
+      }
+    }
+    if (r.failed()) {
+      index.error = r.error();
+      index.error.own();
+      index.entries.clear();
+    }
+  }
+
+  LazyView at_entry(std::size_t i) const {
+    auto view = *this;
+    view.m_begin = m_index->entries[i].begin;
+    view.m_end = m_index->entries[i].end;
+    view.m_index.reset();
+    return view;
+  }
+
+  /// Empty view reporting the error of the index
+  LazyView failed() const {
+    return failed(m_error ? m_error : m_index->error);
+  }
+
+  LazyView failed(Error err) const {
+    auto view = *this;
+    view.m_index.reset();
+    view.m_error = std::move(err);
+    view.m_error.own();
+    return view;
+  }
+
+  std::string_view m_input;
+  std::size_t m_begin;
+  std::size_t m_end;
+  mutable std::shared_ptr<Index> m_index;
+  Error m_error;
+};
+
+} // namespace serde
+
+#endif // SERDE_LAZY_H_
@@ -9,19 +9,681 @@ struct MsgPack;
 
 template <> struct Node<MsgPack> { json j; };
 
+/// Pull reader decoding MessagePack straight into objects
+class MsgPackReader : public StreamReader {
+public:
+  using StreamReader::StreamReader;
+
+  StreamToken peek() {
+    if (m_cur == m_end) {
+      return StreamToken::End;
+    }
+    const auto b = byte();
+    if (b <= 0x7f || b >= 0xe0 || (b >= 0xcc && b <= 0xd3)) {
+      return StreamToken::Integer;
+    }
+    if (b <= 0x8f || b == 0xde || b == 0xdf) {
+      return StreamToken::Object;
+    }
+    if (b <= 0x9f || b == 0xdc || b == 0xdd) {
+      return StreamToken::Array;
+    }
+    if (b <= 0xbf || (b >= 0xd9 && b <= 0xdb)) {
+      return StreamToken::String;
+    }
+    switch (b) {
+    case 0xc0:
+      return StreamToken::Null;
+    case 0xc2:
+    case 0xc3:
+      return StreamToken::Bool;
+    case 0xca:
+    case 0xcb:
+      return StreamToken::Float;
+    case 0xc1:
+      return StreamToken::Invalid;
+    default:
+      // bin and ext
+      return StreamToken::Binary;
+    }
+  }
+
+  bool read_null() {
+    if (m_cur == m_end || byte() != 0xc0) {
+      return fail("Expected nil");
+    }
+    ++m_cur;
+    return true;
+  }
+
+  bool read_bool(bool &v) {
+    if (m_cur == m_end || (byte() != 0xc2 && byte() != 0xc3)) {
+      return fail("Expected boolean");
+    }
+    v = byte() == 0xc3;
+    ++m_cur;
+    return true;
+  }
+
+  template <typename I> bool read_integer(I &v) {
+    StreamInteger n;
+    if (!read_int(n)) {
+      return false;
+    }
+    return internal::fit_integer(n, v) || fail("Integer out of range");
+  }
+
+  template <typename F> bool read_float(F &v) {
+    if (peek() == StreamToken::Integer) {
+      StreamInteger n;
+      if (!read_int(n)) {
+        return false;
+      }
+      v = internal::to_float<F>(n);
+      return true;
+    }
+    if (m_cur != m_end && byte() == 0xca && need(5)) {
+      v = static_cast<F>(
+          internal::bit_cast<float>(internal::load_be<std::uint32_t>(++m_cur)));
+      m_cur += 4;
+      return true;
+    }
+    if (m_cur != m_end && byte() == 0xcb && need(9)) {
+      v = static_cast<F>(internal::bit_cast<double>(
+          internal::load_be<std::uint64_t>(++m_cur)));
+      m_cur += 8;
+      return true;
+    }
+    return fail("Expected number");
+  }
+
+  bool read_string(std::string &v) {
+    std::string_view view;
+    if (!read_str(view)) {
+      return false;
+    }
+    v.assign(view.data(), view.size());
+    return true;
+  }
+
+  bool view_string(std::string_view &v) { return read_str(v); }
+
+  bool begin_array(StreamFrame &frame) {
+    frame = StreamFrame{};
+    frame.sized = true;
+    if (m_cur == m_end) {
+      return fail("Expected array");
+    }
+    const auto b = byte();
+    if (b >= 0x90 && b <= 0x9f) {
+      ++m_cur;
+      frame.size = b & 0x0f;
+      return true;
+    }
+    if (b == 0xdc) {
+      return take_be<std::uint16_t>(frame.size);
+    }
+    if (b == 0xdd) {
+      return take_be<std::uint32_t>(frame.size);
+    }
+    return fail("Expected array");
+  }
+
+  bool next_element(StreamFrame &frame) {
+    if (frame.size == 0) {
+      return false;
+    }
+    --frame.size;
+    return true;
+  }
+
+  bool begin_object(StreamFrame &frame) {
+    frame = StreamFrame{};
+    frame.sized = true;
+    if (m_cur == m_end) {
+      return fail("Expected map");
+    }
+    const auto b = byte();
+    if (b >= 0x80 && b <= 0x8f) {
+      ++m_cur;
+      frame.size = b & 0x0f;
+      return true;
+    }
+    if (b == 0xde) {
+      return take_be<std::uint16_t>(frame.size);
+    }
+    if (b == 0xdf) {
+      return take_be<std::uint32_t>(frame.size);
+    }
+    return fail("Expected map");
+  }
+
+  bool next_key(StreamFrame &frame, std::string_view &key) {
+    if (frame.size == 0) {
+      return false;
+    }
+    --frame.size;
+    return read_str(key);
+  }
+
+  /// Next member keyed by name, or by integer id setting `id`
+  ///
+  /// An integer that can't be an id, e.g. a negative one, is read as its
+  /// decimal text so that it matches no member.
+  bool next_key_id(StreamFrame &frame, std::string_view &key,
+                   std::optional<std::size_t> &id) {
+    if (frame.size == 0) {
+      return false;
+    }
+    --frame.size;
+    id.reset();
+    if (peek() != StreamToken::Integer) {
+      return read_str(key);
+    }
+    StreamInteger n;
+    if (!read_int(n)) {
+      return false;
+    }
+    if (std::size_t v; internal::fit_integer(n, v)) {
+      id = v;
+      return true;
+    }
+    m_key = n.negative ? std::to_string(static_cast<std::int64_t>(n.bits))
+                       : std::to_string(n.bits);
+    key = m_key;
+    return true;
+  }
+
+  /// Skip a value using the lengths in the headers
+  bool skip() {
+    std::size_t pending = 1;
+    while (pending != 0) {
+      --pending;
+      if (m_cur == m_end) {
+        return fail("Unexpected end of input");
+      }
+      const auto b = byte();
+      ++m_cur;
+      if (b <= 0x7f || b >= 0xe0 || b == 0xc0 || b == 0xc2 || b == 0xc3) {
+        continue;
+      }
+      if (b <= 0x8f) {
+        pending += 2 * (b & 0x0f);
+        continue;
+      }
+      if (b <= 0x9f) {
+        pending += b & 0x0f;
+        continue;
+      }
+      if (b <= 0xbf) {
+        if (!advance(b & 0x1f)) {
+          return false;
+        }
+        continue;
+      }
+
+      std::size_t n = 0;
+      bool ok = true;
+      switch (b) {
+      case 0xc4: // bin
+      case 0xd9: // str
+        ok = load<std::uint8_t>(n) && advance(n);
+        break;
+      case 0xc5:
+      case 0xda:
+        ok = load<std::uint16_t>(n) && advance(n);
+        break;
+      case 0xc6:
+      case 0xdb:
+        ok = load<std::uint32_t>(n) && advance(n);
+        break;
+      case 0xc7: // ext
+        ok = load<std::uint8_t>(n) && advance(n + 1);
+        break;
+      case 0xc8:
+        ok = load<std::uint16_t>(n) && advance(n + 1);
+        break;
+      case 0xc9:
+        ok = load<std::uint32_t>(n) && advance(n + 1);
+        break;
+      case 0xcc:
+      case 0xd0:
+        ok = advance(1);
+        break;
+      case 0xcd:
+      case 0xd1:
+        ok = advance(2);
+        break;
+      case 0xca:
+      case 0xce:
+      case 0xd2:
+        ok = advance(4);
+        break;
+      case 0xcb:
+      case 0xcf:
+      case 0xd3:
+        ok = advance(8);
+        break;
+      case 0xd4: // fixext
+        ok = advance(2);
+        break;
+      case 0xd5:
+        ok = advance(3);
+        break;
+      case 0xd6:
+        ok = advance(5);
+        break;
+      case 0xd7:
+        ok = advance(9);
+        break;
+      case 0xd8:
+        ok = advance(17);
+        break;
+      case 0xdc:
+        ok = load<std::uint16_t>(n);
+        pending += n;
+        break;
+      case 0xdd:
+        ok = load<std::uint32_t>(n);
+        pending += n;
+        break;
+      case 0xde:
+        ok = load<std::uint16_t>(n);
+        pending += 2 * n;
+        break;
+      case 0xdf:
+        ok = load<std::uint32_t>(n);
+        pending += 2 * n;
+        break;
+      default:
+        --m_cur;
+        return fail("Bad type");
+      }
+      if (!ok) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool finish() {
+    if (failed()) {
+      return false;
+    }
+    return m_cur == m_end || fail("Unexpected trailing bytes");
+  }
+
+  /// View the elements of a typed array in place: an ext value whose type is
+  /// numbered as a CBOR tag of RFC 8746
+  bool read_bulk(internal::TypedArray &type, std::string_view &bytes) {
+    if (m_cur == m_end) {
+      return false;
+    }
+    const auto begin = m_cur;
+    const auto b = byte();
+    std::size_t n = 0;
+    bool ok = true;
+    if (b >= 0xd4 && b <= 0xd8) {
+      ++m_cur;
+      n = std::size_t(1) << (b - 0xd4);
+    } else if (b == 0xc7) {
+      ok = take_be<std::uint8_t>(n);
+    } else if (b == 0xc8) {
+      ok = take_be<std::uint16_t>(n);
+    } else if (b == 0xc9) {
+      ok = take_be<std::uint32_t>(n);
+    } else {
+      return false;
+    }
+    if (!ok || !need(1)) {
+      return false;
+    }
+    if (!internal::typed_array_of_tag(byte(), type)) {
+      m_cur = begin;
+      return false;
+    }
+    ++m_cur;
+    if (!need(n)) {
+      return false;
+    }
+    bytes = std::string_view(m_cur, n);
+    m_cur += n;
+    return true;
+  }
+
+  /// Decode a value of a type without stream support through the json tree
+  template <typename T> bool fallback(T &v) {
+    const auto begin = m_cur;
+    if (!skip()) {
+      return false;
+    }
+    const auto end = m_cur;
+    m_cur = begin;
+    const Node<JSON> node{json::from_msgpack(begin, end, true, false)};
+    if (node.j.is_discarded() || !unpack_node(node, v)) {
+      return fail("Bad value");
+    }
+    m_cur = end;
+    return true;
+  }
+
+private:
+  unsigned char byte() const { return static_cast<unsigned char>(*m_cur); }
+
+  bool need(std::size_t n) {
+    return remaining() >= n || fail("Unexpected end of input");
+  }
+
+  bool advance(std::size_t n) {
+    if (!need(n)) {
+      return false;
+    }
+    m_cur += n;
+    return true;
+  }
+
+  /// Load a big-endian integer at the cursor
+  template <typename T, typename U> bool load(U &v) {
+    if (!need(sizeof(T))) {
+      return false;
+    }
+    v = internal::load_be<T>(m_cur);
+    m_cur += sizeof(T);
+    return true;
+  }
+
+  /// Skip the type byte and load the big-endian integer following it
+  template <typename T, typename U> bool take_be(U &v) {
+    const auto begin = m_cur++;
+    if (!load<T>(v)) {
+      m_cur = begin;
+      return false;
+    }
+    return true;
+  }
+
+  bool read_int(StreamInteger &n) {
+    if (m_cur == m_end) {
+      return fail("Expected integer");
+    }
+    const auto b = byte();
+    if (b <= 0x7f) {
+      ++m_cur;
+      n = StreamInteger{b, false};
+      return true;
+    }
+    if (b >= 0xe0) {
+      ++m_cur;
+      n = StreamInteger{static_cast<std::uint64_t>(static_cast<std::int8_t>(b)),
+                        true};
+      return true;
+    }
+
+    const auto begin = m_cur++;
+    bool ok = false;
+    switch (b) {
+    case 0xcc:
+      ok = load<std::uint8_t>(n.bits);
+      n.negative = false;
+      break;
+    case 0xcd:
+      ok = load<std::uint16_t>(n.bits);
+      n.negative = false;
+      break;
+    case 0xce:
+      ok = load<std::uint32_t>(n.bits);
+      n.negative = false;
+      break;
+    case 0xcf:
+      ok = load<std::uint64_t>(n.bits);
+      n.negative = false;
+      break;
+    case 0xd0:
+      ok = load_signed<std::uint8_t, std::int8_t>(n);
+      break;
+    case 0xd1:
+      ok = load_signed<std::uint16_t, std::int16_t>(n);
+      break;
+    case 0xd2:
+      ok = load_signed<std::uint32_t, std::int32_t>(n);
+      break;
+    case 0xd3:
+      ok = load_signed<std::uint64_t, std::int64_t>(n);
+      break;
+    default:
+      m_cur = begin;
+      return fail("Expected integer");
+    }
+    if (!ok) {
+      m_cur = begin;
+    }
+    return ok;
+  }
+
+  template <typename U, typename S> bool load_signed(StreamInteger &n) {
+    U u;
+    if (!load<U>(u)) {
+      return false;
+    }
+    const auto s = static_cast<std::int64_t>(static_cast<S>(u));
+    n = StreamInteger{static_cast<std::uint64_t>(s), s < 0};
+    return true;
+  }
+
+  /// Read a string in place
+  bool read_str(std::string_view &v) {
+    if (m_cur == m_end) {
+      return fail("Expected string");
+    }
+    const auto b = byte();
+    const auto begin = m_cur;
+    std::size_t n = 0;
+    bool ok = true;
+    if (b >= 0xa0 && b <= 0xbf) {
+      ++m_cur;
+      n = b & 0x1f;
+    } else if (b == 0xd9) {
+      ok = take_be<std::uint8_t>(n);
+    } else if (b == 0xda) {
+      ok = take_be<std::uint16_t>(n);
+    } else if (b == 0xdb) {
+      ok = take_be<std::uint32_t>(n);
+    } else {
+      return fail("Expected string");
+    }
+    if (!ok || !need(n)) {
+      m_cur = begin;
+      return false;
+    }
+    v = std::string_view(m_cur, n);
+    m_cur += n;
+    return true;
+  }
+
+  /// Text of the last integer key that isn't an id
+  std::string m_key;
+};
+
+/// Writer emitting MessagePack straight from objects
+class MsgPackWriter : public StreamWriter {
+public:
+  using StreamWriter::StreamWriter;
+
+  void write_null() { put(0xc0); }
+
+  void write_bool(bool v) { put(v ? 0xc3 : 0xc2); }
+
+  template <typename I> void write_integer(I v) {
+    if constexpr (std::is_signed_v<I>) {
+      if (v < 0) {
+        write_negative(v);
+        return;
+      }
+    }
+    write_unsigned(static_cast<std::uint64_t>(v));
+  }
+
+  template <typename F> void write_float(F v) {
+    if constexpr (std::is_same_v<F, float>) {
+      put(0xca);
+      internal::store_be(m_out, internal::bit_cast<std::uint32_t>(v));
+    } else {
+      put(0xcb);
+      internal::store_be(m_out, internal::bit_cast<std::uint64_t>(
+                                    static_cast<double>(v)));
+    }
+  }
+
+  void write_string(std::string_view v) {
+    const auto n = v.size();
+    if (n <= 0x1f) {
+      put(0xa0 | n);
+    } else if (n <= 0xff) {
+      put(0xd9);
+      put(n);
+    } else if (n <= 0xffff) {
+      put(0xda);
+      internal::store_be(m_out, static_cast<std::uint16_t>(n));
+    } else if (n <= 0xffffffff) {
+      put(0xdb);
+      internal::store_be(m_out, static_cast<std::uint32_t>(n));
+    } else {
+      fail("String too long");
+      return;
+    }
+    m_out.append(v.data(), n);
+  }
+
+  void begin_array(std::size_t n) { header(n, 0x90, 0xdc); }
+
+  void end_array() {}
+
+  void begin_object(std::size_t n) { header(n, 0x80, 0xde); }
+
+  void write_key(std::string_view key) { write_string(key); }
+
+  void write_encoded_key(std::string_view bytes) { m_out += bytes; }
+
+  void write_key_id(std::size_t id) { write_unsigned(id); }
+
+  void end_object() {}
+
+#if SERDE_TYPED_ARRAYS
+  /// Typed array as an ext value numbered as a CBOR tag of RFC 8746, in the
+  /// byte order of the host
+  template <typename T> bool write_bulk(const T *data, std::size_t n) {
+    const auto size = n * sizeof(T);
+    if (size != 0 && size <= 16 && (size & (size - 1)) == 0) {
+      // fixext 1 to 16
+      put(0xd4 + (size == 1   ? 0
+                  : size == 2 ? 1
+                  : size == 4 ? 2
+                  : size == 8 ? 3
+                              : 4));
+    } else if (size <= 0xff) {
+      put(0xc7);
+      put(size);
+    } else if (size <= 0xffff) {
+      put(0xc8);
+      internal::store_be(m_out, static_cast<std::uint16_t>(size));
+    } else if (size <= 0xffffffff) {
+      put(0xc9);
+      internal::store_be(m_out, static_cast<std::uint32_t>(size));
+    } else {
+      fail("Array too large");
+      return true;
+    }
+    put(internal::typed_array_tag<T>());
+    m_out.append(reinterpret_cast<const char *>(data), size);
+    return true;
+  }
+#endif
+
+  /// Encode a value of a type without stream support through the json tree
+  template <typename T> void fallback(const T &v) {
+    try {
+      const json j = v;
+      json::to_msgpack(j, m_out);
+    } catch (std::exception &e) {
+      fail_copy("Bad value", e.what());
+    }
+  }
+
+private:
+  void put(std::size_t b) { m_out += static_cast<char>(b); }
+
+  void write_unsigned(std::uint64_t v) {
+    if (v <= 0x7f) {
+      put(v);
+    } else if (v <= 0xff) {
+      put(0xcc);
+      put(v);
+    } else if (v <= 0xffff) {
+      put(0xcd);
+      internal::store_be(m_out, static_cast<std::uint16_t>(v));
+    } else if (v <= 0xffffffff) {
+      put(0xce);
+      internal::store_be(m_out, static_cast<std::uint32_t>(v));
+    } else {
+      put(0xcf);
+      internal::store_be(m_out, v);
+    }
+  }
+
+  void write_negative(std::int64_t v) {
+    if (v >= -32) {
+      put(static_cast<std::uint8_t>(v));
+    } else if (v >= std::numeric_limits<std::int8_t>::min()) {
+      put(0xd0);
+      put(static_cast<std::uint8_t>(v));
+    } else if (v >= std::numeric_limits<std::int16_t>::min()) {
+      put(0xd1);
+      internal::store_be(m_out, static_cast<std::uint16_t>(v));
+    } else if (v >= std::numeric_limits<std::int32_t>::min()) {
+      put(0xd2);
+      internal::store_be(m_out, static_cast<std::uint32_t>(v));
+    } else {
+      put(0xd3);
+      internal::store_be(m_out, static_cast<std::uint64_t>(v));
+    }
+  }
+
+  /// Header of array or map
+  void header(std::size_t n, std::size_t fix, std::size_t type16) {
+    if (n <= 0x0f) {
+      put(fix | n);
+    } else if (n <= 0xffff) {
+      put(type16);
+      internal::store_be(m_out, static_cast<std::uint16_t>(n));
+    } else if (n <= 0xffffffff) {
+      put(type16 + 1);
+      internal::store_be(m_out, static_cast<std::uint32_t>(n));
+    } else {
+      fail("Container too large");
+    }
+  }
+};
+
 template <> struct LangHandler<MsgPack> {
+  using Reader = MsgPackReader;
+  using Writer = MsgPackWriter;
+
   static Node<MsgPack> from_string(const std::string &str) {
-    return Node<MsgPack>{json::from_msgpack(str)};
+    return from_bytes(str);
+  }
+
+  static Node<MsgPack> from_bytes(std::string_view bytes) {
+    return Node<MsgPack>{json::from_msgpack(bytes.begin(), bytes.end())};
   }
 
   static std::string to_string(const Node<MsgPack> &node) {
-    auto vec = nlohmann::json::to_msgpack(node.j);
-    return std::string(vec.begin(), vec.end());
+    std::string str;
+    json::to_msgpack(node.j, str);
+    return str;
   }
 
   template <typename T> static T unpack(const Node<MsgPack> &node) {
-    auto jnode = Node<JSON>{node.j};
-    return LangHandler<JSON>::template unpack<T>(jnode);
+    return node.j.get<T>();
   }
 
   template <typename T> static Node<MsgPack> pack(const T &obj) {
@@ -30,12 +692,22 @@ template <> struct LangHandler<MsgPack> {
 
   template <typename T, typename... Args>
   static T unpack_struct(const Node<MsgPack> &node, Member<Args>... args) {
-    auto jnode = Node<JSON>{node.j};
-    return LangHandler<JSON>::template unpack_struct<T>(jnode, args...);
+    return LangHandler<JSON>::template unpack_object<T>(node.j, args...);
+  }
+
+  template <typename T>
+  static bool try_unpack(const Node<MsgPack> &node, T &obj, Error &err) {
+    return LangHandler<JSON>::try_unpack_value(node.j, obj, err);
+  }
+
+  template <typename T>
+  static bool try_unpack_struct(const Node<MsgPack> &node, T &obj,
+                                Error &err) {
+    return LangHandler<JSON>::try_unpack_object(node.j, obj, err);
   }
 
   template <typename T, typename... Args>
-  static Node<MsgPack> pack_struct(Member<Args>... args) {
+  static Node<MsgPack> pack_struct(MemberRef<const Args>... args) {
     return Node<MsgPack>{LangHandler<JSON>::template pack_struct<T>(args...).j};
   }
 };
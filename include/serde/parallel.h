@@ -0,0 +1,291 @@
+#ifndef SERDE_PARALLEL_H_
+#define SERDE_PARALLEL_H_
+
+#include <atomic>
+#include <system_error>
+#include <thread>
+
+#include <serde/stream.h>
+
+namespace serde {
+
+/// How a parallel decode splits its input
+struct ParallelOptions {
+  /// Threads decoding at once, the calling one included; 0 for one per core
+  std::size_t threads = 0;
+  /// Input size below which a chunk isn't worth handing to another thread
+  std::size_t min_chunk = 64 * 1024;
+};
+
+namespace internal {
+
+/// Number of chunks to cut `size` bytes into: a few per thread, so that
+/// threads finishing early take over the rest, or 1 to decode sequentially
+inline std::size_t chunk_count(std::size_t size, std::size_t &threads,
+                               std::size_t min_chunk) {
+  if (threads == 0) {
+    threads = std::thread::hardware_concurrency();
+  }
+  if (threads <= 1) {
+    return 1;
+  }
+  const auto chunks =
+      std::min(threads * 4, size / std::max<std::size_t>(min_chunk, 1));
+  return std::max<std::size_t>(chunks, 1);
+}
+
+/// Run `f(i)` for every chunk index on up to `threads` threads, the calling
+/// one included
+///
+/// Threads take the next chunk from a shared counter. If the system refuses
+/// more threads, those already started do the whole work.
+template <typename F>
+void run_chunks(std::size_t chunks, std::size_t threads, F &&f) {
+  std::atomic<std::size_t> next{0};
+  const auto work = [&] {
+    for (auto i = next++; i < chunks; i = next++) {
+      f(i);
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (std::size_t t = 1; t < std::min(threads, chunks); ++t) {
+    try {
+      pool.emplace_back(work);
+    } catch (std::system_error &) {
+      break;
+    }
+  }
+  work();
+  for (auto &t : pool) {
+    t.join();
+  }
+}
+
+/// Lowest index of a failed chunk; chunks after it needn't be decoded as
+/// only the first error in the input is reported
+class FirstFailure {
+public:
+  bool after(std::size_t i) const { return i > m_index.load(); }
+
+  void set(std::size_t i) {
+    auto cur = m_index.load();
+    while (i < cur && !m_index.compare_exchange_weak(cur, i)) {
+    }
+  }
+
+  std::size_t index() const { return m_index.load(); }
+
+private:
+  std::atomic<std::size_t> m_index{Error::npos};
+};
+
+/// Place where a chunk of a stream starts
+template <typename Mark> struct Cut {
+  Mark mark;
+  /// State of the enclosing array after the first value of the chunk
+  StreamFrame frame;
+  /// Index of the first value of the chunk
+  std::size_t index;
+};
+
+} // namespace internal
+
+/// Decode a large array into a vector of T on several threads
+///
+/// A first pass skips over the elements to cut the array into chunks of
+/// about the same size; the elements of each chunk are then decoded straight
+/// into their place of the result by one of the threads. Pays off for
+/// elements costlier to decode than to skip, such as records with strings.
+/// Malformed input is decoded again on the calling thread to report the same
+/// error as `from_bytes`.
+template <typename Lang, typename T>
+Result<std::vector<T>> parallel_from_bytes(std::string_view bytes,
+                                           ParallelOptions options = {}) {
+  static_assert(internal::has_reader<Lang, T>::value,
+                "Parallel decoding needs a language with a stream reader and "
+                "a default constructible type");
+  static_assert(!std::is_same_v<T, bool>,
+                "Elements of std::vector<bool> can't be written concurrently");
+  using Reader = typename LangHandler<Lang>::Reader;
+  using Cut = internal::Cut<decltype(std::declval<Reader &>().mark())>;
+
+  auto threads = options.threads;
+  const auto chunks =
+      internal::chunk_count(bytes.size(), threads, options.min_chunk);
+  if (chunks == 1) {
+    return internal::parse<Lang, std::vector<T>>(bytes, "parsing bytes");
+  }
+
+  std::vector<Cut> cuts;
+  std::size_t count = 0;
+  {
+    Reader reader(bytes);
+    const auto step = bytes.size() / chunks;
+    std::size_t next_cut = 0;
+    StreamFrame frame;
+    if (!reader.begin_array(frame)) {
+      return internal::parse<Lang, std::vector<T>>(bytes, "parsing bytes");
+    }
+    while (reader.next_element(frame)) {
+      if (reader.offset() >= next_cut) {
+        cuts.push_back(Cut{reader.mark(), frame, count});
+        next_cut = reader.offset() + step;
+      }
+      if (!reader.skip()) {
+        break;
+      }
+      ++count;
+    }
+    if (!reader.finish()) {
+      return internal::parse<Lang, std::vector<T>>(bytes, "parsing bytes");
+    }
+  }
+
+  std::vector<T> out(count);
+  std::vector<Error> errors(cuts.size());
+  internal::FirstFailure failure;
+  internal::run_chunks(cuts.size(), threads, [&](std::size_t i) {
+    if (failure.after(i)) {
+      return;
+    }
+    const auto end = i + 1 < cuts.size() ? cuts[i + 1].index : count;
+    Reader reader(bytes);
+    reader.reset(cuts[i].mark);
+    auto frame = cuts[i].frame;
+    for (auto j = cuts[i].index; j < end; ++j) {
+      if ((j != cuts[i].index && !reader.next_element(frame)) ||
+          !StreamSerde<T>::read(reader, out[j])) {
+        reader.fail("Unexpected end of array");
+        errors[i] = reader.error();
+        failure.set(i);
+        return;
+      }
+    }
+  });
+
+  if (failure.index() != Error::npos) {
+    auto err = std::move(errors[failure.index()]);
+    err.context("parsing bytes");
+    return Result<std::vector<T>>::error(std::move(err));
+  }
+  return Result<std::vector<T>>::value(std::move(out));
+}
+
+/// Decode every record of a buffer into a vector of T on several threads
+///
+/// Records are cut into chunks of about the same size by skipping over them,
+/// or by following their sizes if length-prefixed, and each chunk is decoded
+/// by one of the threads into its place of the result. Malformed input is
+/// decoded again on the calling thread to report the same error as
+/// `records_from_bytes`.
+template <typename Lang, typename T>
+Result<std::vector<T>>
+parallel_records_from_bytes(std::string_view bytes,
+                            Framing framing = Framing::Concatenated,
+                            ParallelOptions options = {}) {
+  static_assert(!std::is_same_v<T, bool>,
+                "Elements of std::vector<bool> can't be written concurrently");
+  const auto sequential = [&] {
+    std::vector<T> out;
+    auto r = records_from_bytes<Lang, T>(
+        bytes, [&](T &obj) { out.push_back(std::move(obj)); }, framing);
+    if (!r) {
+      return Result<std::vector<T>>::error(r.cause());
+    }
+    return Result<std::vector<T>>::value(std::move(out));
+  };
+
+  auto threads = options.threads;
+  const auto chunks =
+      internal::chunk_count(bytes.size(), threads, options.min_chunk);
+  if (chunks == 1) {
+    return sequential();
+  }
+
+  // Offset and index of the first record of each chunk
+  std::vector<std::pair<std::size_t, std::size_t>> cuts;
+  std::size_t count = 0;
+  {
+    typename LangHandler<Lang>::Reader reader(bytes);
+    const auto step = bytes.size() / chunks;
+    std::size_t next_cut = 0;
+    while (!reader.at_end()) {
+      if (reader.offset() >= next_cut) {
+        cuts.emplace_back(reader.offset(), count);
+        next_cut = reader.offset() + step;
+      }
+      if (framing == Framing::Concatenated) {
+        if (!reader.skip()) {
+          return sequential();
+        }
+      } else {
+        const char *outer_end;
+        if (!reader.enter_record(outer_end)) {
+          return sequential();
+        }
+        reader.narrow(reader.offset() + reader.remaining(), bytes.size());
+      }
+      ++count;
+    }
+  }
+
+  std::vector<T> out(count);
+  std::vector<Error> errors(cuts.size());
+  internal::FirstFailure failure;
+  internal::run_chunks(cuts.size(), threads, [&](std::size_t i) {
+    if (failure.after(i)) {
+      return;
+    }
+    const auto end = i + 1 < cuts.size() ? cuts[i + 1]
+                                          : std::pair(bytes.size(), count);
+    RecordReader<Lang, T> records(bytes, cuts[i].first, end.first, framing);
+    for (auto j = cuts[i].second; j < end.second; ++j) {
+      if (!records.next(out[j])) {
+        errors[i] = records.error();
+        failure.set(i);
+        return;
+      }
+    }
+  });
+
+  if (failure.index() != Error::npos) {
+    auto err = std::move(errors[failure.index()]);
+    err.context("parsing records");
+    return Result<std::vector<T>>::error(std::move(err));
+  }
+  return Result<std::vector<T>>::value(std::move(out));
+}
+
+/// Decode a large array of a file on several threads
+///
+/// The file is mapped into memory and unmapped on return.
+template <typename Lang, typename T>
+Result<std::vector<T>> parallel_from_file(const std::string &filename,
+                                          ParallelOptions options = {}) {
+  const auto contents = internal::read_file(filename);
+  if (!contents) {
+    return Result<std::vector<T>>::error(
+        "serde: on parsing file: file not found: " + filename);
+  }
+  return parallel_from_bytes<Lang, T>(contents->view(), options);
+}
+
+/// Decode every record of a file on several threads
+template <typename Lang, typename T>
+Result<std::vector<T>>
+parallel_records_from_file(const std::string &filename,
+                           Framing framing = Framing::Concatenated,
+                           ParallelOptions options = {}) {
+  const auto contents = internal::read_file(filename);
+  if (!contents) {
+    return Result<std::vector<T>>::error(
+        "serde: on parsing records: file not found: " + filename);
+  }
+  return parallel_records_from_bytes<Lang, T>(contents->view(), framing,
+                                              options);
+}
+
+} // namespace serde
+
+#endif // SERDE_PARALLEL_H_
@@ -1,13 +1,22 @@
 #ifndef SERDE_H_
 #define SERDE_H_
 
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <deque>
 #include <fstream>
 #include <list>
 #include <map>
 #include <optional>
+#include <ostream>
 #include <set>
+#include <sstream>
+#include <streambuf>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <type_traits>
 #include <unordered_map>
@@ -18,6 +27,23 @@
 
 #include "map.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#define SERDE_HAS_POSIX 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define SERDE_HAS_POSIX 0
+#endif
+
+#if __has_include(<memory_resource>)
+#define SERDE_HAS_PMR 1
+#include <memory_resource>
+#else
+#define SERDE_HAS_PMR 0
+#endif
+
 /// Local macro helpers
 #define SERDE_CHECK_N(x, n, ...) n
 #define SERDE_CHECK(...) SERDE_CHECK_N(__VA_ARGS__, 0, )
@@ -35,6 +61,10 @@
 
 namespace serde {
 
+template <typename T> struct CoreHandler;
+
+template <typename Lang> struct LangHandler;
+
 namespace internal {
 template <typename T, typename = int>
 struct is_serde_struct : std::false_type {};
@@ -42,10 +72,30 @@ template <typename T>
 struct is_serde_struct<T, decltype((void)T::is_serde_struct, 0)>
     : std::true_type {};
 
-template <typename T> struct CoreHandler;
-template <typename T> struct is_serde_specialized : std::false_type {};
+template <typename T, typename = int>
+struct is_serde_specialized : std::false_type {};
 template <typename T>
-struct is_serde_specialized<CoreHandler<T>> : std::true_type {};
+struct is_serde_specialized<
+    T, decltype((void)CoreHandler<T>::is_serde_specialized, 0)>
+    : std::true_type {};
+
+template <typename Lang, typename = int>
+struct has_from_bytes : std::false_type {};
+template <typename Lang>
+struct has_from_bytes<Lang, decltype((void)LangHandler<Lang>::from_bytes(
+                                         std::string_view()),
+                                     0)> : std::true_type {};
+
+/// Read-only stream buffer over memory owned by someone else
+///
+/// Lets the parsers taking `std::istream` read the input without copying it.
+class ViewStreamBuf : public std::streambuf {
+public:
+  explicit ViewStreamBuf(std::string_view str) {
+    auto p = const_cast<char *>(str.data());
+    setg(p, p, p + str.size());
+  }
+};
 } // namespace internal
 
 /// True for struct with SERDE_DEFINE
@@ -62,6 +112,11 @@ template <typename T>
 inline constexpr bool is_serde_compatible_v =
     is_serde_struct_v<T> || is_serde_specialized_v<T>;
 
+/// True for struct with SERDE_DEFINE/SERDE_ADD_STRUCT
+template <typename T>
+inline constexpr bool is_serde_record_v =
+    is_serde_struct_v<T> || (is_serde_specialized_v<T> && std::is_class_v<T>);
+
 /// Language implementer throws this exception
 class Exception : public std::exception {
 public:
@@ -77,15 +132,275 @@ protected:
   std::string m_msg;
 };
 
-/// Helper class that represents a member of struct or enum
+/// Reason of a failure to decode or encode, reported without throwing
+///
+/// Only a static reason, the offset in the input and the offending name are
+/// recorded; the message is formatted when it is requested. The reason
+/// string is stable, so callers may compare it by address as an error code.
+class Error {
+public:
+  static constexpr std::size_t npos = std::size_t(-1);
+
+  explicit operator bool() const { return m_reason != nullptr; }
+
+  const char *reason() const { return m_reason; }
+
+  std::size_t offset() const { return m_offset; }
+
+  std::string_view detail() const {
+    return m_owned ? std::string_view(m_storage) : m_detail;
+  }
+
+  void set(const char *reason, std::size_t offset, std::string_view detail) {
+    m_reason = reason;
+    m_offset = offset;
+    m_detail = detail;
+    m_owned = false;
+  }
+
+  void set_copy(const char *reason, std::size_t offset, std::string detail) {
+    m_reason = reason;
+    m_offset = offset;
+    m_storage = std::move(detail);
+    m_owned = true;
+  }
+
+  /// Record the first failure; returns false to be returned by the caller
+  bool fail(const char *reason, std::string_view detail = {}) {
+    if (!m_reason) {
+      set(reason, npos, detail);
+    }
+    return false;
+  }
+
+  bool fail_copy(const char *reason, std::string detail) {
+    if (!m_reason) {
+      set_copy(reason, npos, std::move(detail));
+    }
+    return false;
+  }
+
+  void clear() { m_reason = nullptr; }
+
+  /// Copy the offending name out of the input so that the error outlives it
+  void own() {
+    if (!m_owned) {
+      m_storage.assign(m_detail.data(), m_detail.size());
+      m_owned = true;
+    }
+  }
+
+  /// Name what was being done, e.g. "parsing string"
+  void context(const char *context) { m_context = context; }
+
+  std::string message() const {
+    std::string msg;
+    if (m_context) {
+      msg += "serde: on ";
+      msg += m_context;
+      msg += ": ";
+    }
+    msg += m_reason ? m_reason : "No error";
+    if (!detail().empty()) {
+      msg += ": ";
+      msg += detail();
+    }
+    if (m_offset != npos) {
+      msg += " (at offset " + std::to_string(m_offset) + ")";
+    }
+    return msg;
+  }
+
+private:
+  const char *m_reason = nullptr;
+  const char *m_context = nullptr;
+  std::size_t m_offset = npos;
+  std::string_view m_detail;
+  std::string m_storage;
+  bool m_owned = false;
+};
+
+/// Helper class that represents a member of struct to unpack
+///
+/// `make_default` builds the default value only when the member is missing,
+/// or is nullptr if the member is required.
 template <typename T> struct Member {
-  explicit Member(const char *name, const std::optional<T> &value)
-      : name(name), value(value) {}
+  using type = T;
+
+  const char *name;
+  T (*make_default)();
+};
+
+/// Helper class that refers to a member of struct in place
+///
+/// `make_default` is a factory of the default value, or nullptr if the member
+/// is required.
+template <typename T, typename F = std::nullptr_t> struct MemberRef {
+  static constexpr bool has_default = !std::is_same_v<F, std::nullptr_t>;
 
   const char *name;
-  std::optional<T> value;
+  T &value;
+  F make_default;
+};
+
+template <typename T>
+MemberRef<T> make_member_ref(const char *name, T &value) {
+  return MemberRef<T>{name, value, nullptr};
+}
+
+template <typename T, typename F>
+MemberRef<T, F> make_member_ref(const char *name, T &value, F make_default) {
+  return MemberRef<T, F>{name, value, make_default};
+}
+
+/// Hash table from member names to member indices, built at compile time
+///
+/// Names are placed by FNV-1a hash with linear probing in a table of at least
+/// twice the number of members, so a lookup usually costs one hash and one
+/// comparison. `find` returns the number of members for unknown names.
+template <std::size_t N> class FieldIndex {
+public:
+  constexpr explicit FieldIndex(const std::array<std::string_view, N> &names)
+      : m_names(names) {
+    for (auto &slot : m_slots) {
+      slot = N;
+    }
+    for (std::size_t i = 0; i < N; ++i) {
+      auto slot = hash(names[i]) & mask;
+      while (m_slots[slot] != N) {
+        slot = (slot + 1) & mask;
+      }
+      m_slots[slot] = i;
+    }
+  }
+
+  static constexpr std::size_t size() { return N; }
+
+  constexpr std::string_view name(std::size_t i) const { return m_names[i]; }
+
+  constexpr std::size_t find(std::string_view key) const {
+    for (auto slot = hash(key) & mask;; slot = (slot + 1) & mask) {
+      const auto i = m_slots[slot];
+      if (i == N || m_names[i] == key) {
+        return i;
+      }
+    }
+  }
+
+private:
+  static constexpr std::size_t table_size() {
+    std::size_t n = 1;
+    while (n < 2 * N) {
+      n *= 2;
+    }
+    return n;
+  }
+
+  static constexpr std::size_t mask = table_size() - 1;
+
+  static constexpr std::uint32_t hash(std::string_view s) {
+    std::uint32_t h = 2166136261u;
+    for (const char c : s) {
+      h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    return h;
+  }
+
+  std::array<std::string_view, N> m_names;
+  std::array<std::size_t, table_size()> m_slots{};
+};
+
+template <typename... S> constexpr auto make_field_index(S... names) {
+  return FieldIndex<sizeof...(S)>({std::string_view(names)...});
+}
+
+/// Tables between the values of an enum and their names, built at compile
+/// time
+///
+/// Names are looked up through a FieldIndex and values through a hash table
+/// of the same shape, so both directions take constant time. If several names
+/// share a value, the first one is used for packing.
+template <typename E, std::size_t N> class EnumTable {
+public:
+  constexpr EnumTable(const std::array<const char *, N> &names,
+                      const std::array<E, N> &values)
+      : m_index(to_views(names)), m_values(values) {
+    for (auto &slot : m_slots) {
+      slot = N;
+    }
+    for (std::size_t i = 0; i < N; ++i) {
+      auto slot = hash(values[i]) & mask;
+      while (m_slots[slot] != N && m_values[m_slots[slot]] != values[i]) {
+        slot = (slot + 1) & mask;
+      }
+      if (m_slots[slot] == N) {
+        m_slots[slot] = i;
+      }
+    }
+  }
+
+  /// Value with the name, or nullopt
+  constexpr std::optional<E> value(std::string_view name) const {
+    const auto i = m_index.find(name);
+    if (i == N) {
+      return std::nullopt;
+    }
+    return m_values[i];
+  }
+
+  /// Name of the value, or an empty view
+  constexpr std::string_view name(E value) const {
+    for (auto slot = hash(value) & mask;; slot = (slot + 1) & mask) {
+      const auto i = m_slots[slot];
+      if (i == N) {
+        return {};
+      }
+      if (m_values[i] == value) {
+        return m_index.name(i);
+      }
+    }
+  }
+
+private:
+  static constexpr std::array<std::string_view, N>
+  to_views(const std::array<const char *, N> &names) {
+    std::array<std::string_view, N> views{};
+    for (std::size_t i = 0; i < N; ++i) {
+      views[i] = names[i];
+    }
+    return views;
+  }
+
+  static constexpr std::size_t table_size() {
+    std::size_t n = 1;
+    while (n < 2 * N) {
+      n *= 2;
+    }
+    return n;
+  }
+
+  static constexpr std::size_t mask = table_size() - 1;
+
+  static constexpr std::size_t hash(E value) {
+    const auto v = static_cast<std::uint64_t>(value);
+    return static_cast<std::size_t>((v * 0x9e3779b97f4a7c15u) >> 32);
+  }
+
+  FieldIndex<N> m_index;
+  std::array<E, N> m_values;
+  std::array<std::size_t, table_size()> m_slots{};
 };
 
+template <typename E, std::size_t N>
+constexpr auto make_enum_table(const std::array<const char *, N> &names,
+                               const std::array<E, N> &values) {
+  return EnumTable<E, N>(names, values);
+}
+
+/// Format implementer specializes this struct to read values from a stream
+/// reader without building a Node
+template <typename T, typename = void> struct StreamSerde;
+
 /// Language implementer specializes this struct
 template <typename Lang> struct Node;
 
@@ -99,7 +414,26 @@ template <typename Lang> struct Node;
 ///   * template <typename T, typename... Args>
 ///     static T unpack_struct(const Node<MsgPack> &node, Member<Args>... args);
 ///   * template <typename T, typename... Args>
-///     static Node<MsgPack> pack_struct(Member<Args>... args);
+///     static Node<MsgPack> pack_struct(MemberRef<const Args>... args);
+///
+/// These are optional:
+///   * static Node<MsgPack> from_bytes(std::string_view bytes);
+///     Parse without copying the input into a std::string first. Without it,
+///     `from_bytes` copies the input and calls `from_string`.
+///   * using Reader = ...;
+///     Stream reader used by `from_string` to decode directly into the target
+///     object (see serde/stream.h). Without it, `from_string` goes through
+///     Node.
+///   * using Writer = ...;
+///     Stream writer used by `to_string`/`to_buffer` to encode directly into
+///     the output. Without it, they go through Node.
+///   * template <typename T>
+///     static bool try_unpack(const Node<MsgPack> &node, T &obj, Error &err);
+///   * template <typename T>
+///     static bool try_unpack_struct(const Node<MsgPack> &node, T &obj,
+///                                   Error &err);
+///     Decode into `obj` reporting failures in `err` instead of throwing.
+///     Without them, `Core::try_unpack` catches the exceptions of `unpack`.
 template <typename Lang> struct LangHandler;
 
 template <typename T> struct CoreHandler {
@@ -118,8 +452,289 @@ template <typename T> struct CoreHandler {
       return LangHandler<Lang>::template pack<T>(obj);
     }
   }
+
+  template <typename Obj> static auto fields(Obj &obj) {
+    return T::serde_fields(obj);
+  }
+
+  static constexpr auto field_index() { return T::serde_field_index(); }
 };
 
+namespace internal {
+/// Member index of a structure, computed once per type
+template <typename T>
+inline constexpr auto field_index_v = CoreHandler<T>::field_index();
+
+/// Name tables of an enum, computed once per type
+template <typename T>
+inline constexpr auto enum_table_v = CoreHandler<T>::enum_table();
+} // namespace internal
+
+/// Tagging of a std::variant, specialized by SERDE_ADD_VARIANT and
+/// SERDE_ADD_VARIANT_TAG
+///
+/// Variants without it are untagged: the first alternative that decodes wins.
+template <typename V> struct VariantTags;
+
+namespace internal {
+template <typename V, typename = int>
+struct is_tagged_variant : std::false_type {};
+template <typename V>
+struct is_tagged_variant<V, decltype((void)VariantTags<V>::names, 0)>
+    : std::true_type {};
+
+} // namespace internal
+
+/// Integer ids of the members of a structure, in the order of the members
+template <std::size_t N> class MemberIdTable {
+public:
+  constexpr explicit MemberIdTable(const std::array<std::size_t, N> &ids)
+      : m_ids(ids) {}
+
+  static constexpr std::size_t size() { return N; }
+
+  constexpr std::size_t id(std::size_t i) const { return m_ids[i]; }
+
+  /// Index of the member with the id, or N if there's none
+  constexpr std::size_t find(std::size_t id) const {
+    if (id < N && m_ids[id] == id) {
+      return id;
+    }
+    for (std::size_t i = 0; i < N; ++i) {
+      if (m_ids[i] == id) {
+        return i;
+      }
+    }
+    return N;
+  }
+
+  constexpr bool distinct() const {
+    for (std::size_t i = 0; i < N; ++i) {
+      for (std::size_t j = 0; j < i; ++j) {
+        if (m_ids[i] == m_ids[j]) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+private:
+  std::array<std::size_t, N> m_ids;
+};
+
+template <typename... I> constexpr auto make_member_ids(I... ids) {
+  return MemberIdTable<sizeof...(I)>({static_cast<std::size_t>(ids)...});
+}
+
+/// Ids equal to the positions of the members
+template <std::size_t N> constexpr auto make_positional_ids() {
+  std::array<std::size_t, N> ids{};
+  for (std::size_t i = 0; i < N; ++i) {
+    ids[i] = i;
+  }
+  return MemberIdTable<N>(ids);
+}
+
+/// Integer keys of the members of a structure in binary formats, specialized
+/// by SERDE_ADD_IDS and SERDE_ADD_POSITIONAL_IDS
+///
+/// Structures without it are keyed by the names of their members.
+template <typename T> struct MemberIds;
+
+/// Whether a structure rejects members it doesn't know instead of skipping
+/// them, specialized by SERDE_DENY_UNKNOWN
+template <typename T> struct DenyUnknown : std::false_type {};
+
+namespace internal {
+template <typename T, typename = int>
+struct has_member_ids : std::false_type {};
+template <typename T>
+struct has_member_ids<T, decltype((void)MemberIds<T>::ids, 0)>
+    : std::true_type {};
+
+/// Runtime index to alternative of a variant: emplace the alternative at `i`
+/// and call `f` with it
+template <typename V, typename F, std::size_t... I>
+bool with_alternative(V &v, std::size_t i, F &&f, std::index_sequence<I...>) {
+  return ((i == I && f(v.template emplace<I>())) || ...);
+}
+
+template <typename V, typename F>
+bool with_alternative(V &v, std::size_t i, F &&f) {
+  return with_alternative(
+      v, i, f, std::make_index_sequence<std::variant_size_v<V>>{});
+}
+
+/// Call `f(member, index)` on each member until it returns true
+template <typename Tuple, typename F, std::size_t... I>
+bool any_member(Tuple &members, F &&f, std::index_sequence<I...>) {
+  return (f(std::get<I>(members), I) || ...);
+}
+
+template <typename Tuple, typename F> bool any_member(Tuple &members, F &&f) {
+  return any_member(members, f,
+                    std::make_index_sequence<std::tuple_size_v<Tuple>>{});
+}
+
+/// Call `f(member, index)` on the member at a runtime index
+///
+/// Dispatches through a table of functions rather than comparing the index
+/// with each member.
+template <typename Tuple, typename F, std::size_t... I>
+bool visit_member(Tuple &members, std::size_t i, F &f,
+                  std::index_sequence<I...>) {
+  using Fn = bool (*)(Tuple &, F &);
+  static constexpr Fn table[] = {
+      [](Tuple &t, F &fn) { return fn(std::get<I>(t), I); }...};
+  return table[i](members, f);
+}
+
+template <typename Tuple, typename F>
+bool visit_member(Tuple &members, std::size_t i, F &&f) {
+  return visit_member(members, i, f,
+                      std::make_index_sequence<std::tuple_size_v<Tuple>>{});
+}
+
+template <typename T> struct is_optional : std::false_type {};
+template <typename T> struct is_optional<std::optional<T>> : std::true_type {};
+
+template <typename T> struct is_variant : std::false_type {};
+template <typename... T>
+struct is_variant<std::variant<T...>> : std::true_type {};
+
+template <typename T> struct is_sequence : std::false_type {};
+template <typename T, typename A>
+struct is_sequence<std::vector<T, A>> : std::true_type {};
+template <typename T, typename A>
+struct is_sequence<std::deque<T, A>> : std::true_type {};
+template <typename T, typename A>
+struct is_sequence<std::list<T, A>> : std::true_type {};
+template <typename T, typename C, typename A>
+struct is_sequence<std::set<T, C, A>> : std::true_type {};
+template <typename T, typename H, typename E, typename A>
+struct is_sequence<std::unordered_set<T, H, E, A>> : std::true_type {};
+
+template <typename T> struct is_tuple_like : std::false_type {};
+template <typename... T>
+struct is_tuple_like<std::tuple<T...>> : std::true_type {};
+template <typename T, typename U>
+struct is_tuple_like<std::pair<T, U>> : std::true_type {};
+template <typename T, std::size_t N>
+struct is_tuple_like<std::array<T, N>> : std::true_type {};
+
+template <typename T, typename N> bool probe(const N &node);
+
+template <typename T, typename N, std::size_t... I>
+bool probe_tuple(const N &node, std::index_sequence<I...>) {
+  return node.is_array() && node.size() == sizeof...(I) &&
+         (probe<std::tuple_element_t<I, T>>(node.at(I)) && ...);
+}
+
+template <typename V, typename N, std::size_t... I>
+bool probe_variant(const N &node, std::index_sequence<I...>) {
+  return (probe<std::variant_alternative_t<I, V>>(node) || ...);
+}
+
+template <typename T, typename N, std::size_t... I>
+bool probe_record(const N &node, std::index_sequence<I...>) {
+  using Fields = decltype(CoreHandler<T>::fields(std::declval<T &>()));
+  if (!node.is_object()) {
+    return false;
+  }
+  std::array<bool, sizeof...(I)> seen{};
+  const bool ok = node.all_members([&](std::string_view key, const N &child) {
+    const auto i = field_index_v<T>.find(key);
+    if (i == sizeof...(I)) {
+      return true;
+    }
+    seen[i] = true;
+    return ((i != I ||
+             probe<std::decay_t<
+                 decltype(std::declval<std::tuple_element_t<I, Fields>>()
+                              .value)>>(child)) &&
+            ...);
+  });
+  return ok &&
+         ((seen[I] || std::tuple_element_t<I, Fields>::has_default) && ...);
+}
+
+/// Check without decoding whether a node can hold a T
+///
+/// False means decoding would fail. True is exact for scalars, enums,
+/// sequences, tuples, variants and structures made of them; for other types
+/// (maps, custom converters) it only means decoding is worth trying.
+///
+/// `N` is a view of the Node of a language providing is_null, is<T> for
+/// arithmetic types and std::string, string, is_array, size, at,
+/// all_elements, is_object and all_members.
+template <typename T, typename N> bool probe(const N &node) {
+  if constexpr (is_optional<T>::value) {
+    return node.is_null() || probe<typename T::value_type>(node);
+  } else if constexpr (std::is_enum_v<T>) {
+    if constexpr (is_serde_specialized_v<T>) {
+      std::string_view name;
+      return node.string(name) && enum_table_v<T>.value(name);
+    } else {
+      return node.template is<std::underlying_type_t<T>>();
+    }
+  } else if constexpr (std::is_arithmetic_v<T> ||
+                       std::is_same_v<T, std::string>) {
+    return node.template is<T>();
+  } else if constexpr (is_tagged_variant<T>::value) {
+    return node.is_object();
+  } else if constexpr (is_variant<T>::value) {
+    return probe_variant<T>(
+        node, std::make_index_sequence<std::variant_size_v<T>>{});
+  } else if constexpr (is_sequence<T>::value) {
+    return node.is_array() && node.all_elements([](const N &e) {
+      return probe<typename T::value_type>(e);
+    });
+  } else if constexpr (is_tuple_like<T>::value) {
+    return probe_tuple<T>(node,
+                          std::make_index_sequence<std::tuple_size_v<T>>{});
+  } else if constexpr (is_serde_record_v<T>) {
+    using Fields = decltype(CoreHandler<T>::fields(std::declval<T &>()));
+    return probe_record<T>(
+        node, std::make_index_sequence<std::tuple_size_v<Fields>>{});
+  } else {
+    return true;
+  }
+}
+} // namespace internal
+
+namespace internal {
+template <typename Lang, typename T, typename = int>
+struct has_core_try_unpack : std::false_type {};
+template <typename Lang, typename T>
+struct has_core_try_unpack<
+    Lang, T,
+    decltype((void)CoreHandler<T>::template try_unpack<Lang>(
+                 std::declval<const Node<Lang> &>(), std::declval<T &>(),
+                 std::declval<Error &>()),
+             0)> : std::true_type {};
+
+template <typename Lang, typename T, typename = int>
+struct has_lang_try_unpack : std::false_type {};
+template <typename Lang, typename T>
+struct has_lang_try_unpack<
+    Lang, T,
+    decltype((void)LangHandler<Lang>::template try_unpack<T>(
+                 std::declval<const Node<Lang> &>(), std::declval<T &>(),
+                 std::declval<Error &>()),
+             0)> : std::true_type {};
+
+template <typename Lang, typename T, typename = int>
+struct has_try_unpack_struct : std::false_type {};
+template <typename Lang, typename T>
+struct has_try_unpack_struct<
+    Lang, T,
+    decltype((void)LangHandler<Lang>::template try_unpack_struct<T>(
+                 std::declval<const Node<Lang> &>(), std::declval<T &>(),
+                 std::declval<Error &>()),
+             0)> : std::true_type {};
+} // namespace internal
+
 /// Language implementer calls these methods whenever needed
 struct Core {
   template <typename Lang>
@@ -127,6 +742,15 @@ struct Core {
     return LangHandler<Lang>::from_string(str);
   }
 
+  template <typename Lang>
+  static Node<Lang> from_bytes(std::string_view bytes) {
+    if constexpr (internal::has_from_bytes<Lang>::value) {
+      return LangHandler<Lang>::from_bytes(bytes);
+    } else {
+      return LangHandler<Lang>::from_string(std::string(bytes));
+    }
+  }
+
   template <typename Lang>
   static std::string to_string(const Node<Lang> &node) {
     return LangHandler<Lang>::to_string(node);
@@ -140,82 +764,116 @@ struct Core {
     return CoreHandler<T>::template pack<Lang>(obj);
   }
 
+  /// Decode into `obj` without throwing for malformed input
+  ///
+  /// Returns false with the reason in `err`; `obj` is then partially
+  /// assigned. Handlers without support for it are called under try/catch.
+  template <typename Lang, typename T>
+  static bool try_unpack(const Node<Lang> &node, T &obj, Error &err) {
+    if constexpr (internal::has_core_try_unpack<Lang, T>::value) {
+      return CoreHandler<T>::template try_unpack<Lang>(node, obj, err);
+    } else if constexpr (is_serde_struct_v<T>) {
+      return try_unpack_struct<Lang, T>(node, obj, err);
+    } else if constexpr (is_serde_specialized_v<T>) {
+      return catch_unpack<Lang, T>(node, obj, err);
+    } else {
+      return try_unpack_value<Lang, T>(node, obj, err);
+    }
+  }
+
 private:
   template <typename T> friend struct CoreHandler;
 
-  template <typename Lang, typename T, typename... Args>
-  static T unpack_enum(const Node<Lang> &node, Member<Args>... args) {
-    auto enum_str = CoreHandler<std::string>::template unpack<Lang>(node);
+  template <typename Lang, typename T>
+  static bool catch_unpack(const Node<Lang> &node, T &obj, Error &err) {
+    try {
+      obj = CoreHandler<T>::template unpack<Lang>(node);
+      return true;
+    } catch (std::exception &e) {
+      return err.fail_copy("Bad value", e.what());
+    }
+  }
 
-    std::optional<T> result;
+  template <typename Lang, typename T>
+  static bool try_unpack_value(const Node<Lang> &node, T &obj, Error &err) {
+    if constexpr (internal::has_lang_try_unpack<Lang, T>::value) {
+      return LangHandler<Lang>::template try_unpack<T>(node, obj, err);
+    } else {
+      return catch_unpack<Lang, T>(node, obj, err);
+    }
+  }
 
-    auto check_member = [&](auto &mem) {
-      if (result) {
-        return;
-      }
-      if (mem.name == enum_str) {
-        if (!mem.value) {
-          throw Exception("Library bug: " + std::string(mem.name) +
-                          " is missing value");
-        }
-        result = mem.value.value();
-      }
-    };
+  template <typename Lang, typename T>
+  static bool try_unpack_struct(const Node<Lang> &node, T &obj, Error &err) {
+    if constexpr (internal::has_try_unpack_struct<Lang, T>::value) {
+      return LangHandler<Lang>::template try_unpack_struct<T>(node, obj, err);
+    } else {
+      return catch_unpack<Lang, T>(node, obj, err);
+    }
+  }
 
-    (check_member(args), ...);
+  template <typename Lang, typename T>
+  static bool try_unpack_enum(const Node<Lang> &node, T &obj, Error &err) {
+    std::string name;
+    if (!try_unpack<Lang, std::string>(node, name, err)) {
+      return false;
+    }
+    const auto value = internal::enum_table_v<T>.value(name);
+    if (!value) {
+      return err.fail_copy("Bad enum value", std::move(name));
+    }
+    obj = value.value();
+    return true;
+  }
 
-    if (!result) {
+  template <typename Lang, typename T>
+  static T unpack_enum(const Node<Lang> &node) {
+    const auto enum_str = CoreHandler<std::string>::template unpack<Lang>(node);
+    const auto value = internal::enum_table_v<T>.value(enum_str);
+    if (!value) {
       throw Exception("Bad enum value: " + enum_str);
     }
-
-    return result.value();
+    return value.value();
   }
 
-  template <typename Lang, typename T, typename... Args>
-  static Node<Lang> pack_enum(const T &value, Member<Args>... args) {
-    std::optional<Node<Lang>> result;
-
-    auto check_member = [&](auto &mem) {
-      if (result) {
-        return;
-      }
-
-      if (!mem.value) {
-        throw Exception("Library bug: " + std::string(mem.name) +
-                        " is missing value");
-      }
-
-      if (mem.value.value() == value) {
-        result = CoreHandler<std::string>::template pack<Lang>(mem.name);
-      }
-    };
-
-    (check_member(args), ...);
-
-    if (!result) {
+  template <typename Lang, typename T>
+  static Node<Lang> pack_enum(const T &value) {
+    const auto name = internal::enum_table_v<T>.name(value);
+    if (name.empty()) {
       throw Exception(
           "Bad enum value: " +
           std::to_string(static_cast<std::underlying_type_t<T>>(value)));
     }
-
-    return result.value();
+    return CoreHandler<std::string>::template pack<Lang>(std::string(name));
   }
 };
 
 } // namespace serde
 
-/// Construct a member variable object
-#define SERDE_MEM_PACK(X) ::serde::Member<decltype(X)>(#X, obj.X)
+/// Refer to a member variable to pack without copying it
+#define SERDE_MEM_PACK(X) ::serde::make_member_ref(#X, obj.X)
 
 /// Pack a member variable (emitter doesn't care default)
 #define SERDE_MEM_PACK_WITH_DEFAULT(X, ...) SERDE_MEM_PACK(X)
 
 /// Construct a member variable object
-#define SERDE_MEM_UNPACK(X) ::serde::Member<decltype(X)>(#X, std::nullopt)
+#define SERDE_MEM_UNPACK(X)                                                    \
+  ::serde::Member<decltype(StructType::X)>{#X, nullptr}
 
-/// Construct a member variable object with default value
+/// Construct a member variable object with a factory of its default value
 #define SERDE_MEM_UNPACK_WITH_DEFAULT(X, ...)                                  \
-  ::serde::Member<decltype(X)>(#X, std::make_optional<decltype(X)>(__VA_ARGS__))
+  ::serde::Member<decltype(StructType::X)>{#X, [] {                            \
+    return decltype(StructType::X)(__VA_ARGS__);                               \
+  }}
+
+/// Refer to a member variable in place
+#define SERDE_MEM_REF(X) ::serde::make_member_ref(#X, obj.X)
+
+/// Refer to a member variable in place with its default value
+#define SERDE_MEM_REF_WITH_DEFAULT(X, ...)                                     \
+  ::serde::make_member_ref(#X, obj.X, [] {                                     \
+    return std::decay_t<decltype(obj.X)>(__VA_ARGS__);                         \
+  })
 
 /// Pack a member variable resolving default value macro syntax
 #define SERDE_PACK(X)                                                          \
@@ -226,22 +884,46 @@ private:
   SERDE_IIF(SERDE_IS_PAREN(X))                                                 \
   (SERDE_MEM_UNPACK_WITH_DEFAULT X, SERDE_MEM_UNPACK(X))
 
-/// Construct an enum member object
-#define SERDE_ENUM_MEM(E) ::serde::Member<EnumType>(#E, EnumType::E)
+/// Name of a member variable
+#define SERDE_MEM_NAME(X) #X
+
+/// Name of a member variable with its default value
+#define SERDE_MEM_NAME_WITH_DEFAULT(X, ...) #X
+
+/// Name of a member variable resolving default value macro syntax
+#define SERDE_NAME(X)                                                          \
+  SERDE_IIF(SERDE_IS_PAREN(X))(SERDE_MEM_NAME_WITH_DEFAULT X, SERDE_MEM_NAME(X))
+
+/// Refer to a member variable resolving default value macro syntax
+#define SERDE_REF(X)                                                           \
+  SERDE_IIF(SERDE_IS_PAREN(X))(SERDE_MEM_REF_WITH_DEFAULT X, SERDE_MEM_REF(X))
+
+/// Name of an enum member
+#define SERDE_ENUM_NAME(E) #E
+
+/// Value of an enum member
+#define SERDE_ENUM_VALUE(E) EnumType::E
 
 /// Register a new enum for packing/unpacking
 #define SERDE_ADD_ENUM(E, ...)                                                 \
   namespace serde {                                                            \
   template <> struct CoreHandler<E> {                                          \
+    static constexpr bool is_serde_specialized = true;                         \
     template <typename Lang> static E unpack(const Node<Lang> &node) {         \
-      using EnumType = E;                                                      \
-      return Core::unpack_enum<Lang, E>(                                       \
-          node, MAP_LIST(SERDE_ENUM_MEM, __VA_ARGS__));                        \
+      return Core::unpack_enum<Lang, E>(node);                                 \
     }                                                                          \
     template <typename Lang> static Node<Lang> pack(const E &obj) {            \
+      return Core::pack_enum<Lang, E>(obj);                                    \
+    }                                                                          \
+    template <typename Lang>                                                   \
+    static bool try_unpack(const Node<Lang> &node, E &obj, Error &err) {       \
+      return Core::try_unpack_enum<Lang, E>(node, obj, err);                   \
+    }                                                                          \
+    static constexpr auto enum_table() {                                       \
       using EnumType = E;                                                      \
-      return Core::pack_enum<Lang, E>(obj,                                     \
-                                      MAP_LIST(SERDE_ENUM_MEM, __VA_ARGS__));  \
+      return ::serde::make_enum_table(                                         \
+          std::array{MAP_LIST(SERDE_ENUM_NAME, __VA_ARGS__)},                  \
+          std::array{MAP_LIST(SERDE_ENUM_VALUE, __VA_ARGS__)});                \
     }                                                                          \
   };                                                                           \
   } // namespace serde
@@ -251,16 +933,26 @@ private:
 #define SERDE_ADD_STRUCT(T, ...)                                               \
   namespace serde {                                                            \
   template <> struct CoreHandler<T> {                                          \
+    static constexpr bool is_serde_specialized = true;                         \
     template <typename Lang> static T unpack(const Node<Lang> &node) {         \
       using StructType = T;                                                    \
       return LangHandler<Lang>::template unpack_struct<T>(                     \
           node, MAP_LIST(SERDE_UNPACK, __VA_ARGS__));                          \
     }                                                                          \
     template <typename Lang> static Node<Lang> pack(const T &obj) {            \
-      using StructType = T;                                                    \
       return LangHandler<Lang>::template pack_struct<T>(                       \
           MAP_LIST(SERDE_PACK, __VA_ARGS__));                                  \
     }                                                                          \
+    template <typename Lang>                                                   \
+    static bool try_unpack(const Node<Lang> &node, T &obj, Error &err) {       \
+      return Core::try_unpack_struct<Lang, T>(node, obj, err);                 \
+    }                                                                          \
+    template <typename Obj> static auto fields(Obj &obj) {                     \
+      return std::make_tuple(MAP_LIST(SERDE_REF, __VA_ARGS__));                \
+    }                                                                          \
+    static constexpr auto field_index() {                                      \
+      return ::serde::make_field_index(MAP_LIST(SERDE_NAME, __VA_ARGS__));     \
+    }                                                                          \
   };                                                                           \
   } // namespace serde
 
@@ -269,6 +961,7 @@ private:
 #define SERDE_DEFINE(...)                                                      \
   template <typename Lang, typename T>                                         \
   static T serde_unpack(const ::serde::Node<Lang> &node) {                     \
+    using StructType = T;                                                      \
     return ::serde::LangHandler<Lang>::template unpack_struct<T>(              \
         node, MAP_LIST(SERDE_UNPACK, __VA_ARGS__));                            \
   }                                                                            \
@@ -277,23 +970,180 @@ private:
     return ::serde::LangHandler<Lang>::template pack_struct<T>(                \
         MAP_LIST(SERDE_PACK, __VA_ARGS__));                                    \
   }                                                                            \
+  template <typename Obj> static auto serde_fields(Obj &obj) {                 \
+    return std::make_tuple(MAP_LIST(SERDE_REF, __VA_ARGS__));                  \
+  }                                                                            \
+  static constexpr auto serde_field_index() {                                  \
+    return ::serde::make_field_index(MAP_LIST(SERDE_NAME, __VA_ARGS__));       \
+  }                                                                            \
   static bool is_serde_struct;                                                 \
   template <typename T> friend struct ::serde::CoreHandler;
 
+/// Register a variant encoded as an object whose only key names the
+/// alternative, e.g. {"Ping": {...}}
+///
+/// Names are string literals in the order of the alternatives. Use an alias
+/// for the variant type as it contains commas.
+#define SERDE_ADD_VARIANT(V, ...)                                              \
+  namespace serde {                                                            \
+  template <> struct VariantTags<V> {                                          \
+    static constexpr std::string_view tag{};                                   \
+    static constexpr auto names = make_field_index(__VA_ARGS__);               \
+    static_assert(names.size() == std::variant_size_v<V>);                     \
+  };                                                                           \
+  } // namespace serde
+
+/// Register a variant of structures encoded as the structure with the name of
+/// the alternative in an extra member `TAG`, e.g. {"type": "Ping", ...}
+#define SERDE_ADD_VARIANT_TAG(V, TAG, ...)                                     \
+  namespace serde {                                                            \
+  template <> struct VariantTags<V> {                                          \
+    static constexpr std::string_view tag = TAG;                               \
+    static constexpr auto names = make_field_index(__VA_ARGS__);               \
+    static_assert(names.size() == std::variant_size_v<V>);                     \
+  };                                                                           \
+  } // namespace serde
+
+/// Key the members of a structure by integer ids instead of their names in
+/// binary formats, e.g. {1: "name", 2: 42} in MsgPack
+///
+/// Ids are given in the order of the members. Members are read keyed by id or
+/// by name, and unknown ids are skipped, so keep the ids of the members in use
+/// when adding or removing others. Text formats still use the names.
+#define SERDE_ADD_IDS(T, ...)                                                  \
+  namespace serde {                                                            \
+  template <> struct MemberIds<T> {                                            \
+    static constexpr auto ids = make_member_ids(__VA_ARGS__);                  \
+    static_assert(ids.size() == internal::field_index_v<T>.size(),             \
+                  "One id per member");                                        \
+    static_assert(ids.distinct(), "Ids of members must be distinct");          \
+  };                                                                           \
+  } // namespace serde
+
+/// Key the members of a structure by their positions in binary formats; new
+/// members must then be added last
+#define SERDE_ADD_POSITIONAL_IDS(T)                                            \
+  namespace serde {                                                            \
+  template <> struct MemberIds<T> {                                            \
+    static constexpr auto ids =                                                \
+        make_positional_ids<internal::field_index_v<T>.size()>();              \
+  };                                                                           \
+  } // namespace serde
+
+/// Fail decoding a structure on members it doesn't know, e.g. to catch typos
+/// in configuration files
+///
+/// By default they are skipped over without being decoded, so that readers
+/// keep up with producers adding members.
+#define SERDE_DENY_UNKNOWN(T)                                                  \
+  namespace serde {                                                            \
+  template <> struct DenyUnknown<T> : std::true_type {};                       \
+  } // namespace serde
+
 /// Syntax for setting default value
 #define SERDE_OPT(...) (__VA_ARGS__)
 
 namespace serde::internal {
 
-inline std::optional<std::string> read_file(const std::string &filename) {
-  std::ifstream in(filename, std::ios::in | std::ios::binary);
-  if (!in) {
+/// Contents of a file, mapped into memory where possible
+///
+/// Falls back to a single read into a buffer of the file size when the file
+/// can't be mapped (empty files, pipes, platforms without mmap).
+class FileContents {
+public:
+  FileContents() = default;
+
+  FileContents(const FileContents &) = delete;
+  FileContents &operator=(const FileContents &) = delete;
+
+  FileContents(FileContents &&other) noexcept
+      : m_map(std::exchange(other.m_map, nullptr)),
+        m_size(std::exchange(other.m_size, 0)),
+        m_buf(std::move(other.m_buf)) {}
+
+  FileContents &operator=(FileContents &&other) noexcept {
+    if (this != &other) {
+      unmap();
+      m_map = std::exchange(other.m_map, nullptr);
+      m_size = std::exchange(other.m_size, 0);
+      m_buf = std::move(other.m_buf);
+    }
+    return *this;
+  }
+
+  ~FileContents() { unmap(); }
+
+  std::string_view view() const {
+    return m_map ? std::string_view(m_map, m_size) : std::string_view(m_buf);
+  }
+
+  /// Returns false if the file can't be opened
+  bool open(const std::string &filename) {
+#if SERDE_HAS_POSIX
+    const int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      void *p = ::mmap(nullptr, static_cast<std::size_t>(st.st_size),
+                       PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        ::close(fd);
+        m_map = static_cast<const char *>(p);
+        m_size = static_cast<std::size_t>(st.st_size);
+        ::madvise(p, m_size, MADV_SEQUENTIAL);
+        return true;
+      }
+    }
+    ::close(fd);
+#endif
+    return read(filename);
+  }
+
+private:
+  bool read(const std::string &filename) {
+    std::ifstream in(filename, std::ios::in | std::ios::binary);
+    if (!in) {
+      return false;
+    }
+    in.seekg(0, std::ios::end);
+    const auto size = in.tellg();
+    in.seekg(0, std::ios::beg);
+    if (size > 0 && in) {
+      m_buf.resize(static_cast<std::size_t>(size));
+      in.read(&m_buf[0], size);
+      m_buf.resize(static_cast<std::size_t>(in.gcount()));
+    } else {
+      // Size unknown; read until the end
+      in.clear();
+      std::ostringstream contents;
+      contents << in.rdbuf();
+      m_buf = contents.str();
+    }
+    return true;
+  }
+
+  void unmap() {
+#if SERDE_HAS_POSIX
+    if (m_map) {
+      ::munmap(const_cast<char *>(m_map), m_size);
+    }
+#endif
+    m_map = nullptr;
+  }
+
+  const char *m_map = nullptr;
+  std::size_t m_size = 0;
+  std::string m_buf;
+};
+
+inline std::optional<FileContents> read_file(const std::string &filename) {
+  FileContents contents;
+  if (!contents.open(filename)) {
     return {};
   }
-  std::ostringstream contents;
-  contents << in.rdbuf();
-  in.close();
-  return (contents.str());
+  return contents;
 }
 
 } // namespace serde::internal
@@ -301,6 +1151,8 @@ inline std::optional<std::string> read_file(const std::string &filename) {
 namespace serde {
 
 /// Optional value with error reason
+///
+/// The message of an Error is only formatted if `error()` is called.
 template <typename T> class Result {
 public:
   template <typename U> static Result<T> value(U &&value) {
@@ -309,58 +1161,390 @@ public:
   template <typename U> static Result<T> error(U &&error) {
     return Result<T>(std::nullopt, std::forward<U>(error));
   }
+  static Result<T> error(Error error) {
+    error.own();
+    Result<T> r(std::nullopt, "");
+    r.m_cause = std::move(error);
+    return r;
+  }
 
   explicit operator bool() const { return bool(m_value); }
 
   const T &value() const & { return m_value.value(); }
 
-  T &&value() const && { return std::move(m_value.value()); }
+  T &&value() && { return std::move(m_value.value()); }
 
-  const std::string &error() const & { return m_error; }
+  const std::string &error() const & {
+    format();
+    return m_error;
+  }
+
+  std::string &&error() && {
+    format();
+    return std::move(m_error);
+  }
 
-  std::string &&error() const && { return std::move(m_error); }
+  /// Unformatted error; empty unless the failure was reported as an Error
+  const Error &cause() const { return m_cause; }
 
 private:
   template <typename U, typename E>
   Result(U &&value, E &&error)
       : m_value(std::forward<U>(value)), m_error(std::forward<E>(error)) {}
 
+  void format() const {
+    if (m_cause && m_error.empty()) {
+      m_error = m_cause.message();
+    }
+  }
+
   std::optional<T> m_value;
-  std::string m_error;
+  mutable std::string m_error;
+  Error m_cause;
 };
 
+namespace internal {
+
+#if SERDE_HAS_PMR
+using MemoryResource = std::pmr::memory_resource;
+#else
+using MemoryResource = void;
+#endif
+
+template <typename Lang, typename T, typename = void>
+struct has_reader : std::false_type {};
+template <typename Lang, typename T>
+struct has_reader<Lang, T, std::void_t<typename LangHandler<Lang>::Reader>>
+    : std::is_default_constructible<T> {};
+
+template <typename Lang, typename = void>
+struct has_writer : std::false_type {};
+template <typename Lang>
+struct has_writer<Lang, std::void_t<typename LangHandler<Lang>::Writer>>
+    : std::true_type {};
+
+/// Decode the input in place; `context` names the input in error messages
+///
+/// Malformed input is reported without throwing by the stream readers and
+/// `Core::try_unpack`; only exceptions of the language library itself, such
+/// as syntax errors of a Node parser, are caught. `resource`, if any, is
+/// handed to the stream reader for the `std::pmr` containers of the result.
+template <typename Lang, typename T>
+Result<T> parse(std::string_view str, const char *context,
+                MemoryResource *resource = nullptr) try {
+  Error err;
+  if constexpr (has_reader<Lang, T>::value) {
+    typename LangHandler<Lang>::Reader reader(str);
+#if SERDE_HAS_PMR
+    reader.use_resource(resource);
+#else
+    (void)resource;
+#endif
+    T obj{};
+    if (StreamSerde<T>::read(reader, obj) && reader.finish()) {
+      return Result<T>::value(std::move(obj));
+    }
+    err = reader.error();
+  } else if constexpr (std::is_default_constructible_v<T>) {
+    const auto node = Core::from_bytes<Lang>(str);
+    T obj{};
+    if (Core::try_unpack<Lang, T>(node, obj, err)) {
+      return Result<T>::value(std::move(obj));
+    }
+  } else {
+    const auto node = Core::from_bytes<Lang>(str);
+    return Result<T>::value(Core::unpack<Lang, T>(node));
+  }
+  err.context(context);
+  return Result<T>::error(std::move(err));
+} catch (std::exception &e) {
+  return Result<T>::error("serde: on " + std::string(context) + ": " +
+                          e.what());
+}
+
+/// Decode the input into an existing object
+template <typename Lang, typename T>
+Result<std::size_t> parse_into(std::string_view str, T &obj,
+                               const char *context) try {
+  Error err;
+  if constexpr (has_reader<Lang, T>::value) {
+    typename LangHandler<Lang>::Reader reader(str);
+    if (StreamSerde<T>::read(reader, obj) && reader.finish()) {
+      return Result<std::size_t>::value(str.size());
+    }
+    err = reader.error();
+  } else {
+    const auto node = Core::from_bytes<Lang>(str);
+    if (Core::try_unpack<Lang, T>(node, obj, err)) {
+      return Result<std::size_t>::value(str.size());
+    }
+  }
+  err.context(context);
+  return Result<std::size_t>::error(std::move(err));
+} catch (std::exception &e) {
+  return Result<std::size_t>::error("serde: on " + std::string(context) +
+                                    ": " + e.what());
+}
+
+} // namespace internal
+
+/// Parse a string
+template <typename Lang, typename T>
+Result<T> from_string(const std::string &str) {
+  return internal::parse<Lang, T>(str, "parsing string");
+}
+
+/// Parse a buffer without copying it
+///
+/// `std::string_view` members of the result refer into the buffer, so it must
+/// outlive them. Borrowing needs a language with a stream reader and fails on
+/// strings the format stores escaped or in chunks.
+template <typename Lang, typename T>
+Result<T> from_bytes(std::string_view bytes) {
+  return internal::parse<Lang, T>(bytes, "parsing bytes");
+}
+
+/// Parse a buffer without copying it
+template <typename Lang, typename T>
+Result<T> from_bytes(const std::byte *data, std::size_t size) {
+  return from_bytes<Lang, T>(
+      std::string_view(reinterpret_cast<const char *>(data), size));
+}
+
+/// Parse a buffer without copying it
+template <typename Lang, typename T>
+Result<T> from_bytes(const std::vector<std::byte> &bytes) {
+  return from_bytes<Lang, T>(bytes.data(), bytes.size());
+}
+
+/// Parse a string into an existing object
+///
+/// Members are overwritten in place: strings and vectors, including those of
+/// members and elements, keep their capacity, so decoding message after
+/// message into the same object seldom allocates. Languages without a stream
+/// reader still build their Node first. Returns the number of bytes decoded;
+/// on error the object is left partly decoded.
+template <typename Lang, typename T>
+Result<std::size_t> from_string_into(const std::string &str, T &obj) {
+  return internal::parse_into<Lang, T>(str, obj, "parsing string");
+}
+
+/// Parse a buffer without copying it into an existing object
+template <typename Lang, typename T>
+Result<std::size_t> from_bytes_into(std::string_view bytes, T &obj) {
+  return internal::parse_into<Lang, T>(bytes, obj, "parsing bytes");
+}
+
+#if SERDE_HAS_PMR
+/// Parse a string building the `std::pmr` containers of the result on a
+/// memory resource
+///
+/// Containers such as `std::pmr::string` and `std::pmr::vector`, including
+/// the members of structures, take their memory from `resource`, so a
+/// `std::pmr::monotonic_buffer_resource` releases a whole message at once.
+/// The result must not outlive the resource. Languages without a stream
+/// reader decode through their Node as usual and ignore the resource.
+template <typename Lang, typename T>
+Result<T> from_string(const std::string &str,
+                      std::pmr::memory_resource *resource) {
+  return internal::parse<Lang, T>(str, "parsing string", resource);
+}
+
+/// Parse a buffer without copying it, building the `std::pmr` containers of
+/// the result on a memory resource
+template <typename Lang, typename T>
+Result<T> from_bytes(std::string_view bytes,
+                     std::pmr::memory_resource *resource) {
+  return internal::parse<Lang, T>(bytes, "parsing bytes", resource);
+}
+#endif
+
+namespace internal {
+
+/// True if T holds a `std::string_view`, which would refer into the input
+template <typename T, typename = void> struct borrows : std::false_type {};
+
+template <> struct borrows<std::string_view> : std::true_type {};
+
+template <template <typename...> class C, typename... A>
+struct borrows<C<A...>, std::enable_if_t<!is_serde_record_v<C<A...>>>>
+    : std::disjunction<borrows<A>...> {};
+
+template <typename T, std::size_t N>
+struct borrows<std::array<T, N>> : borrows<T> {};
+
+template <typename Fields> struct fields_borrow;
+
+template <typename... F>
+struct fields_borrow<std::tuple<F...>>
+    : std::disjunction<
+          borrows<std::decay_t<decltype(std::declval<F>().value)>>...> {};
+
+template <typename T>
+struct borrows<T, std::enable_if_t<is_serde_record_v<T>>>
+    : fields_borrow<decltype(CoreHandler<T>::fields(std::declval<T &>()))> {};
+
+} // namespace internal
+
 /// Parse a file
+///
+/// The file is mapped into memory and decoded in place. It is unmapped on
+/// return, so the result can't hold `std::string_view`s.
 template <typename Lang, typename T>
-Result<T> from_file(const std::string &filename) try {
-  const auto str = internal::read_file(filename);
-  if (!str) {
+Result<T> from_file(const std::string &filename) {
+  static_assert(!internal::borrows<T>::value,
+                "from_file can't decode into std::string_view, which would "
+                "refer to the unmapped file; use std::string");
+  const auto contents = internal::read_file(filename);
+  if (!contents) {
     return Result<T>::error("serde: on parsing file: file not found: " +
                             filename);
   }
 
-  const auto node = Core::from_string<Lang>(str.value());
-  return Result<T>::value(Core::unpack<Lang, T>(node));
-} catch (std::exception &e) {
-  return Result<T>::error("serde: on parsing string: " + std::string(e.what()));
+  return internal::parse<Lang, T>(contents->view(), "parsing file");
 }
 
-/// Parse a string
+namespace internal {
+
+/// Pack into the end of a buffer; `context` names the output in error messages
 template <typename Lang, typename T>
-Result<T> from_string(const std::string &str) try {
-  const auto node = Core::from_string<Lang>(str);
-  return Result<T>::value(Core::unpack<Lang, T>(node));
+Result<std::size_t> emit(const T &obj, std::string &out,
+                         const char *context) try {
+  const auto size = out.size();
+  if constexpr (has_writer<Lang>::value) {
+    typename LangHandler<Lang>::Writer writer(out);
+    StreamSerde<T>::write(writer, obj);
+    if (writer.failed()) {
+      out.resize(size);
+      auto err = writer.error();
+      err.context(context);
+      return Result<std::size_t>::error(std::move(err));
+    }
+  } else {
+    const auto node = Core::pack<Lang, T>(obj);
+    out += Core::to_string<Lang>(node);
+  }
+  return Result<std::size_t>::value(out.size() - size);
 } catch (std::exception &e) {
-  return Result<T>::error("serde: on parsing string: " + std::string(e.what()));
+  return Result<std::size_t>::error("serde: on " + std::string(context) +
+                                    ": " + e.what());
+}
+
+/// Call `f` with an empty per-thread buffer whose capacity is reused
+///
+/// Capacity beyond a few megabytes is released afterwards so that one large
+/// value doesn't pin its size for the life of the thread.
+template <typename F> auto with_scratch(F f) {
+  static constexpr std::size_t max_retained = 4 << 20;
+  thread_local std::string buf;
+  buf.clear();
+  auto result = f(buf);
+  if (buf.capacity() > max_retained) {
+    std::string().swap(buf);
+  }
+  return result;
+}
+
+/// Pack and write to a stream
+template <typename Lang, typename T>
+Result<std::size_t> emit(const T &obj, std::ostream &os, const char *context) {
+  return with_scratch([&](std::string &buf) {
+    auto size = emit<Lang, T>(obj, buf, context);
+    if (size && !os.write(buf.data(), buf.size())) {
+      return Result<std::size_t>::error("serde: on " + std::string(context) +
+                                        ": write failed");
+    }
+    return size;
+  });
+}
+
+} // namespace internal
+
+/// Pack into the end of a buffer
+///
+/// The buffer is not cleared so that the caller can reuse its capacity across
+/// calls. Returns the number of bytes appended; on error the buffer is left
+/// as it was.
+template <typename Lang, typename T>
+Result<std::size_t> to_buffer(const T &obj, std::string &out) {
+  return internal::emit<Lang, T>(obj, out, "emitting to buffer");
+}
+
+/// Pack into the end of a byte buffer
+template <typename Lang, typename T>
+Result<std::size_t> to_buffer(const T &obj, std::vector<std::byte> &out) {
+  return internal::with_scratch([&](std::string &buf) {
+    auto size = internal::emit<Lang, T>(obj, buf, "emitting to buffer");
+    if (size) {
+      const auto p = reinterpret_cast<const std::byte *>(buf.data());
+      out.insert(out.end(), p, p + buf.size());
+    }
+    return size;
+  });
 }
 
+/// Pack into a stream
+///
+/// The value is written with a single call; returns the number of bytes.
+template <typename Lang, typename T>
+Result<std::size_t> to_stream(const T &obj, std::ostream &os) {
+  return internal::emit<Lang, T>(obj, os, "emitting to stream");
+}
+
+/// Pack into a file, replacing its contents
+template <typename Lang, typename T>
+Result<std::size_t> to_file(const T &obj, const std::string &filename) {
+  std::ofstream out(filename,
+                    std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out) {
+    return Result<std::size_t>::error(
+        "serde: on emitting to file: can't open: " + filename);
+  }
+  return internal::emit<Lang, T>(obj, out, "emitting to file");
+}
+
+#if SERDE_HAS_POSIX
+/// Pack into a file descriptor such as a socket or a pipe
+///
+/// Short writes are retried until the whole value is written.
+template <typename Lang, typename T>
+Result<std::size_t> to_fd(const T &obj, int fd) {
+  return internal::with_scratch([&](std::string &buf) {
+    auto size = internal::emit<Lang, T>(obj, buf, "emitting to fd");
+    for (std::size_t done = 0; size && done < buf.size();) {
+      const auto n = ::write(fd, buf.data() + done, buf.size() - done);
+      if (n < 0 && errno != EINTR) {
+        return Result<std::size_t>::error(
+            "serde: on emitting to fd: write failed: " +
+            std::string(std::strerror(errno)));
+      }
+      if (n == 0) {
+        // Nothing was written and no error was set; retrying would spin
+        return Result<std::size_t>::error(
+            "serde: on emitting to fd: write failed: no progress");
+      }
+      done += n > 0 ? static_cast<std::size_t>(n) : 0;
+    }
+    return size;
+  });
+}
+#endif
+
 /// Pack into a string
+///
+/// Languages with a stream writer (JSON, MsgPack, CBOR and UBJSON) write the
+/// members of a structure in declaration order, after the tag of a variant if
+/// it has one. Other languages, and `Core::pack`, build a tree whose keys
+/// come out in the order of the language, e.g. sorted by nlohmann::json.
 template <typename Lang, typename T>
-Result<std::string> to_string(const T &obj) try {
-  const auto node = Core::pack<Lang, T>(obj);
-  return Result<std::string>::value(Core::to_string<Lang>(node));
-} catch (std::exception &e) {
-  return Result<std::string>::error("serde: on emitting to string: " +
-                                    std::string(e.what()));
+Result<std::string> to_string(const T &obj) {
+  std::string str;
+  auto size = internal::emit<Lang, T>(obj, str, "emitting to string");
+  if (!size) {
+    return size.cause() ? Result<std::string>::error(size.cause())
+                        : Result<std::string>::error(std::move(size).error());
+  }
+  return Result<std::string>::value(std::move(str));
 }
 
 } // namespace serde
@@ -5,7 +5,9 @@
 
 #include <serde/cbor.h>
 #include <serde/json.h>
+#include <serde/lazy.h>
 #include <serde/msgpack.h>
+#include <serde/parallel.h>
 #include <serde/toml.h>
 #include <serde/ubjson.h>
 #include <serde/yaml.h>
@@ -0,0 +1,266 @@
+#ifndef SERDE_SIMD_H_
+#define SERDE_SIMD_H_
+
+#include <cstdint>
+#include <cstring>
+
+/// Vector scans of text; define SERDE_NO_SIMD to use the scalar loops only
+#if !defined(SERDE_NO_SIMD) && defined(__SSE2__)
+#define SERDE_HAS_SSE2 1
+#include <immintrin.h>
+#else
+#define SERDE_HAS_SSE2 0
+#endif
+
+/// AVX2 kernels are compiled in and picked at run time if the CPU has them
+#if SERDE_HAS_SSE2 && (defined(__GNUC__) || defined(__clang__))
+#define SERDE_HAS_AVX2 1
+#define SERDE_AVX2 __attribute__((target("avx2")))
+#else
+#define SERDE_HAS_AVX2 0
+#endif
+
+namespace serde::internal {
+
+inline bool is_json_ws(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+namespace scalar {
+
+inline const char *scan_string(const char *p, const char *end, bool &ascii) {
+  for (; p != end; ++p) {
+    const auto c = static_cast<unsigned char>(*p);
+    if (c == '"' || c == '\\' || c < 0x20) {
+      break;
+    }
+    ascii &= c < 0x80;
+  }
+  return p;
+}
+
+inline const char *scan_non_ws(const char *p, const char *end) {
+  while (p != end && is_json_ws(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+} // namespace scalar
+
+#if SERDE_HAS_SSE2
+namespace sse2 {
+
+inline __m128i load(const char *p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+inline __m128i eq(__m128i v, char c) {
+  return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+/// Bit i set if byte i is a quote, a backslash or a control character
+inline unsigned string_mask(__m128i v) {
+  const auto ctrl = _mm_max_epu8(v, _mm_set1_epi8(0x1f));
+  return _mm_movemask_epi8(_mm_or_si128(
+      _mm_or_si128(eq(v, '"'), eq(v, '\\')), eq(ctrl, 0x1f)));
+}
+
+inline unsigned non_ws_mask(__m128i v) {
+  const auto ws = _mm_or_si128(_mm_or_si128(eq(v, ' '), eq(v, '\n')),
+                               _mm_or_si128(eq(v, '\r'), eq(v, '\t')));
+  return ~_mm_movemask_epi8(ws) & 0xffff;
+}
+
+inline const char *scan_string(const char *p, const char *end, bool &ascii) {
+  unsigned high = 0;
+  for (; end - p >= 16; p += 16) {
+    const auto v = load(p);
+    const auto m = string_mask(v);
+    const unsigned h = _mm_movemask_epi8(v);
+    if (m != 0) {
+      ascii &= (high | (h & ((1u << __builtin_ctz(m)) - 1))) == 0;
+      return p + __builtin_ctz(m);
+    }
+    high |= h;
+  }
+  ascii &= high == 0;
+  return scalar::scan_string(p, end, ascii);
+}
+
+inline const char *scan_non_ws(const char *p, const char *end) {
+  for (; end - p >= 16; p += 16) {
+    if (const auto m = non_ws_mask(load(p))) {
+      return p + __builtin_ctz(m);
+    }
+  }
+  return scalar::scan_non_ws(p, end);
+}
+
+} // namespace sse2
+#endif
+
+#if SERDE_HAS_AVX2
+namespace avx2 {
+
+SERDE_AVX2 inline __m256i load(const char *p) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+
+SERDE_AVX2 inline __m256i eq(__m256i v, char c) {
+  return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+}
+
+SERDE_AVX2 inline unsigned string_mask(__m256i v) {
+  const auto ctrl = _mm256_max_epu8(v, _mm256_set1_epi8(0x1f));
+  return _mm256_movemask_epi8(_mm256_or_si256(
+      _mm256_or_si256(eq(v, '"'), eq(v, '\\')), eq(ctrl, 0x1f)));
+}
+
+SERDE_AVX2 inline unsigned non_ws_mask(__m256i v) {
+  const auto ws =
+      _mm256_or_si256(_mm256_or_si256(eq(v, ' '), eq(v, '\n')),
+                      _mm256_or_si256(eq(v, '\r'), eq(v, '\t')));
+  return ~static_cast<unsigned>(_mm256_movemask_epi8(ws));
+}
+
+SERDE_AVX2 inline const char *scan_string(const char *p, const char *end,
+                                          bool &ascii) {
+  unsigned high = 0;
+  for (; end - p >= 32; p += 32) {
+    const auto v = load(p);
+    const auto m = string_mask(v);
+    const unsigned h = _mm256_movemask_epi8(v);
+    if (m != 0) {
+      const auto n = __builtin_ctz(m);
+      ascii &= (high | (h & ((1u << n) - 1))) == 0;
+      return p + n;
+    }
+    high |= h;
+  }
+  ascii &= high == 0;
+  return sse2::scan_string(p, end, ascii);
+}
+
+SERDE_AVX2 inline const char *scan_non_ws(const char *p, const char *end) {
+  for (; end - p >= 32; p += 32) {
+    if (const auto m = non_ws_mask(load(p))) {
+      return p + __builtin_ctz(m);
+    }
+  }
+  return sse2::scan_non_ws(p, end);
+}
+
+} // namespace avx2
+#endif
+
+/// Scans of JSON text for the instruction set of the CPU, picked once
+struct JsonScan {
+  const char *(*string)(const char *, const char *, bool &);
+  const char *(*non_ws)(const char *, const char *);
+};
+
+inline const JsonScan &json_scan() {
+  static const JsonScan scan = [] {
+#if SERDE_HAS_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+      return JsonScan{avx2::scan_string, avx2::scan_non_ws};
+    }
+#endif
+#if SERDE_HAS_SSE2
+    return JsonScan{sse2::scan_string, sse2::scan_non_ws};
+#else
+    return JsonScan{scalar::scan_string, scalar::scan_non_ws};
+#endif
+  }();
+  return scan;
+}
+
+/// Find the end of the plain run of a JSON string: the first quote,
+/// backslash or control character, or `end`
+///
+/// `ascii` is cleared if the run has bytes outside ASCII. Most strings end
+/// within the first block, which is scanned inline.
+inline const char *scan_string(const char *p, const char *end, bool &ascii) {
+#if SERDE_HAS_SSE2
+  if (end - p >= 16) {
+    const auto v = sse2::load(p);
+    const unsigned h = _mm_movemask_epi8(v);
+    if (const auto m = sse2::string_mask(v)) {
+      ascii &= (h & ((1u << __builtin_ctz(m)) - 1)) == 0;
+      return p + __builtin_ctz(m);
+    }
+    ascii &= h == 0;
+    return json_scan().string(p + 16, end, ascii);
+  }
+#endif
+  return scalar::scan_string(p, end, ascii);
+}
+
+/// Skip JSON whitespace; single separators between tokens don't leave the
+/// inline loop
+inline const char *scan_non_ws(const char *p, const char *end) {
+  for (int i = 0; i < 2; ++i, ++p) {
+    if (p == end || !is_json_ws(*p)) {
+      return p;
+    }
+  }
+  return json_scan().non_ws(p, end);
+}
+
+/// Find the first byte of a sequence that isn't well-formed UTF-8, or `end`
+///
+/// Overlong forms, surrogates and code points over U+10FFFF are rejected.
+/// Runs of ASCII are skipped a word at a time.
+inline const char *utf8_error(const char *p, const char *end) {
+  while (p != end) {
+    if (end - p >= 8) {
+      std::uint64_t word;
+      std::memcpy(&word, p, 8);
+      if ((word & 0x8080808080808080u) == 0) {
+        p += 8;
+        continue;
+      }
+    }
+    const auto c = static_cast<unsigned char>(*p);
+    if (c < 0x80) {
+      ++p;
+      continue;
+    }
+    int n;
+    unsigned char lo = 0x80;
+    unsigned char hi = 0xbf;
+    if (c >= 0xc2 && c <= 0xdf) {
+      n = 1;
+    } else if (c >= 0xe0 && c <= 0xef) {
+      n = 2;
+      lo = c == 0xe0 ? 0xa0 : 0x80;
+      hi = c == 0xed ? 0x9f : 0xbf;
+    } else if (c >= 0xf0 && c <= 0xf4) {
+      n = 3;
+      lo = c == 0xf0 ? 0x90 : 0x80;
+      hi = c == 0xf4 ? 0x8f : 0xbf;
+    } else {
+      return p;
+    }
+    if (end - p <= n) {
+      return p;
+    }
+    // Only the second byte has a narrower range
+    const auto second = static_cast<unsigned char>(p[1]);
+    if (second < lo || second > hi) {
+      return p;
+    }
+    for (int i = 2; i <= n; ++i) {
+      if ((static_cast<unsigned char>(p[i]) & 0xc0) != 0x80) {
+        return p;
+      }
+    }
+    p += n + 1;
+  }
+  return end;
+}
+
+} // namespace serde::internal
+
+#endif // SERDE_SIMD_H_
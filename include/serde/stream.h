@@ -0,0 +1,1602 @@
+#ifndef SERDE_STREAM_H_
+#define SERDE_STREAM_H_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <new>
+#include <string_view>
+
+#include <serde/serde.h>
+
+/// Write vectors and arrays of numbers to CBOR as typed arrays (RFC 8746) and
+/// to MsgPack as ext values with the same type numbers, copying them at once
+///
+/// Off by default as decoders without support see byte strings. Readers take
+/// typed arrays either way, and UBJSON always writes its own typed containers.
+#ifndef SERDE_TYPED_ARRAYS
+#define SERDE_TYPED_ARRAYS 0
+#endif
+
+namespace serde {
+
+/// Kind of the next value in a stream
+enum class StreamToken {
+  Null,
+  Bool,
+  Integer,
+  Float,
+  String,
+  Array,
+  Object,
+  Binary,
+  End,
+  Invalid,
+};
+
+/// State of an array or object being read, kept by the caller
+struct StreamFrame {
+  /// Number of remaining entries if the format encodes it
+  std::size_t size = 0;
+  bool sized = false;
+  bool first = true;
+  /// Type of every element if the format declares it for the container
+  char type = 0;
+};
+
+/// Common part of stream readers: the input, the cursor and the sticky error
+///
+/// Format implementer derives from this class and provides:
+///   * StreamToken peek();
+///   * bool read_null();
+///   * bool read_bool(bool &v);
+///   * template <typename I> bool read_integer(I &v);
+///   * template <typename F> bool read_float(F &v);
+///   * bool read_string(std::string &v);
+///   * bool view_string(std::string_view &v);
+///     Borrow a string from the input, failing if it isn't stored verbatim.
+///   * bool begin_array(StreamFrame &frame);
+///   * bool next_element(StreamFrame &frame);
+///   * bool begin_object(StreamFrame &frame);
+///   * bool next_key(StreamFrame &frame, std::string_view &key);
+///   * bool skip();
+///   * bool finish();
+///   * template <typename T> bool fallback(T &v);
+///
+/// Formats with padding between values also hide `at_end`. Binary formats
+/// with typed arrays also provide
+///   * bool read_bulk(internal::TypedArray &type, std::string_view &bytes);
+///     View the elements of a typed array in place, or return false without
+///     failing if the next value isn't one.
+/// and their writers
+///   * template <typename T> bool write_bulk(const T *data, std::size_t n);
+///     Write a typed array, or return false if there is none for T.
+///
+/// Every method returns false on failure after recording the error.
+/// `next_element` and `next_key` also return false at the end of the
+/// container, which callers tell apart with `failed()`.
+class StreamReader {
+public:
+  /// Position to backtrack to
+  struct Mark {
+    const char *cur;
+  };
+
+  explicit StreamReader(std::string_view input)
+      : m_begin(input.data()), m_cur(input.data()),
+        m_end(input.data() + input.size()) {}
+
+  bool failed() const { return bool(m_error); }
+
+  const Error &error() const { return m_error; }
+
+  bool fail(const char *what, std::string_view detail = {}) {
+    if (!m_error) {
+      m_error.set(what, offset(), detail);
+    }
+    return false;
+  }
+
+  bool fail_copy(const char *what, std::string detail) {
+    if (!m_error) {
+      m_error.set_copy(what, offset(), std::move(detail));
+    }
+    return false;
+  }
+
+  std::size_t offset() const { return m_cur - m_begin; }
+
+  std::size_t remaining() const { return m_end - m_cur; }
+
+  /// True if no value is left in the input
+  bool at_end() { return m_cur == m_end; }
+
+  /// Enter a record of a length-prefixed stream: a 32-bit big-endian size
+  /// followed by the value, which becomes the whole input until
+  /// `leave_record` is called with `outer_end`
+  bool enter_record(const char *&outer_end) {
+    if (remaining() < 4) {
+      return fail("Truncated record size");
+    }
+    std::size_t size = 0;
+    for (int i = 0; i < 4; ++i) {
+      size = (size << 8) | static_cast<unsigned char>(*m_cur++);
+    }
+    if (remaining() < size) {
+      return fail("Truncated record");
+    }
+    outer_end = m_end;
+    m_end = m_cur + size;
+    return true;
+  }
+
+  void leave_record(const char *outer_end) { m_end = outer_end; }
+
+  /// Read only `[begin, end)` of the input, keeping offsets relative to the
+  /// whole of it
+  void narrow(std::size_t begin, std::size_t end) {
+    m_cur = m_begin + begin;
+    m_end = m_begin + end;
+  }
+
+  Mark mark() const { return Mark{m_cur}; }
+
+  void reset(Mark mark) {
+    m_cur = mark.cur;
+    m_error.clear();
+  }
+
+#if SERDE_HAS_PMR
+  /// Memory resource for the `std::pmr` containers being decoded, or null
+  std::pmr::memory_resource *resource() const { return m_resource; }
+
+  void use_resource(std::pmr::memory_resource *resource) {
+    m_resource = resource;
+  }
+#endif
+
+  /// Decode a value of a type without stream support from a Node parsed out
+  /// of the input, failing at the current offset
+  template <typename Lang, typename T>
+  bool unpack_node(const Node<Lang> &node, T &v) {
+    Error err;
+    if (Core::try_unpack<Lang, T>(node, v, err)) {
+      return true;
+    }
+    return fail_copy(err.reason(), std::string(err.detail()));
+  }
+
+protected:
+  const char *m_begin;
+  const char *m_cur;
+  const char *m_end;
+  Error m_error;
+#if SERDE_HAS_PMR
+  std::pmr::memory_resource *m_resource = nullptr;
+#endif
+};
+
+/// Common part of stream writers: the output and the sticky error
+///
+/// Format implementer derives from this class and provides:
+///   * void write_null();
+///   * void write_bool(bool v);
+///   * template <typename I> void write_integer(I v);
+///   * template <typename F> void write_float(F v);
+///   * void write_string(std::string_view v);
+///   * void begin_array(std::size_t size);
+///   * void end_array();
+///   * void begin_object(std::size_t size);
+///   * void write_key(std::string_view key);
+///   * void end_object();
+///   * template <typename T> void fallback(const T &v);
+///
+/// Output is appended to the buffer; errors are checked once with `failed()`
+/// after the whole value is written.
+class StreamWriter {
+public:
+  explicit StreamWriter(std::string &out) : m_out(out) {}
+
+  bool failed() const { return bool(m_error); }
+
+  const Error &error() const { return m_error; }
+
+  void fail(const char *what, std::string_view detail = {}) {
+    if (!m_error) {
+      m_error.set(what, m_out.size(), detail);
+    }
+  }
+
+  void fail_copy(const char *what, std::string detail) {
+    if (!m_error) {
+      m_error.set_copy(what, m_out.size(), std::move(detail));
+    }
+  }
+
+protected:
+  std::string &m_out;
+  Error m_error;
+};
+
+/// Integer decoded from a binary format
+struct StreamInteger {
+  /// Two's complement bits if negative
+  std::uint64_t bits;
+  bool negative;
+};
+
+namespace internal {
+
+/// Convert an integer checking it fits in the destination type
+template <typename I> bool fit_integer(const StreamInteger &n, I &v) {
+  if (n.negative) {
+    if constexpr (std::is_unsigned_v<I>) {
+      return false;
+    } else {
+      const auto s = static_cast<std::int64_t>(n.bits);
+      if (s < std::numeric_limits<I>::min()) {
+        return false;
+      }
+      v = static_cast<I>(s);
+      return true;
+    }
+  }
+  if (n.bits > static_cast<std::uint64_t>(std::numeric_limits<I>::max())) {
+    return false;
+  }
+  v = static_cast<I>(n.bits);
+  return true;
+}
+
+template <typename F> F to_float(const StreamInteger &n) {
+  return n.negative ? static_cast<F>(static_cast<std::int64_t>(n.bits))
+                    : static_cast<F>(n.bits);
+}
+
+/// Load an unsigned big-endian integer
+template <typename T> T load_be(const char *p) {
+  T v = 0;
+  for (std::size_t i = 0; i < sizeof(T); ++i) {
+    v = static_cast<T>(v << 8) | static_cast<unsigned char>(p[i]);
+  }
+  return v;
+}
+
+/// Append an unsigned big-endian integer
+template <typename T> void store_be(std::string &out, T v) {
+  char buf[sizeof(T)];
+  for (std::size_t i = 0; i < sizeof(T); ++i) {
+    buf[sizeof(T) - 1 - i] = static_cast<char>(v >> (8 * i));
+  }
+  out.append(buf, sizeof(T));
+}
+
+template <typename To, typename From> To bit_cast(const From &from) {
+  static_assert(sizeof(To) == sizeof(From));
+  To to;
+  std::memcpy(&to, &from, sizeof(To));
+  return to;
+}
+
+/// Unsigned integer of N bytes
+template <std::size_t N> struct uint_of;
+template <> struct uint_of<1> { using type = std::uint8_t; };
+template <> struct uint_of<2> { using type = std::uint16_t; };
+template <> struct uint_of<4> { using type = std::uint32_t; };
+template <> struct uint_of<8> { using type = std::uint64_t; };
+
+inline bool little_endian() {
+  const std::uint16_t one = 1;
+  unsigned char low;
+  std::memcpy(&low, &one, 1);
+  return low == 1;
+}
+
+template <typename U> U byteswap(U v) {
+#if defined(__GNUC__) || defined(__clang__)
+  if constexpr (sizeof(U) == 2) {
+    return __builtin_bswap16(v);
+  } else if constexpr (sizeof(U) == 4) {
+    return __builtin_bswap32(v);
+  } else if constexpr (sizeof(U) == 8) {
+    return __builtin_bswap64(v);
+  }
+#endif
+  U r = 0;
+  for (std::size_t i = 0; i < sizeof(U); ++i) {
+    r = static_cast<U>((r << 8) | (v & 0xff));
+    v = static_cast<U>(v >> 8);
+  }
+  return r;
+}
+
+/// Reverse the bytes of each of `n` elements of `Size` bytes in place, which
+/// needn't be aligned
+template <std::size_t Size> void byteswap_all(void *data, std::size_t n) {
+  if constexpr (Size > 1) {
+    using U = typename uint_of<Size>::type;
+    const auto p = static_cast<char *>(data);
+    for (std::size_t i = 0; i < n; ++i) {
+      U v;
+      std::memcpy(&v, p + i * Size, Size);
+      v = byteswap(v);
+      std::memcpy(p + i * Size, &v, Size);
+    }
+  }
+}
+
+/// Element type of a typed array in a binary format
+struct TypedArray {
+  bool is_float;
+  bool is_signed;
+  bool little;
+  /// Bytes per element
+  std::size_t size;
+};
+
+/// Arithmetic types that containers store as typed arrays
+template <typename T>
+constexpr bool is_typed_element_v =
+    (std::is_integral_v<T> && !std::is_same_v<T, bool>) ||
+    std::is_same_v<T, float> || std::is_same_v<T, double>;
+
+/// Typed array numbered as a CBOR tag of RFC 8746, 64 to 87; 16 and 128-bit
+/// floats aren't supported
+inline bool typed_array_of_tag(std::uint64_t tag, TypedArray &type) {
+  if (tag < 64 || tag > 87 || tag == 76) {
+    return false;
+  }
+  const auto bits = tag - 64;
+  type.is_float = bits & 0x10;
+  type.is_signed = bits & 0x08;
+  type.little = bits & 0x04;
+  if (type.is_float) {
+    type.size = std::size_t(2) << (bits & 3);
+    return type.size == 4 || type.size == 8;
+  }
+  type.size = std::size_t(1) << (bits & 3);
+  return true;
+}
+
+/// Tag of RFC 8746 for an array of T in the byte order of the host
+template <typename T> std::uint64_t typed_array_tag() {
+  constexpr std::uint64_t ll = sizeof(T) == 1   ? 0
+                               : sizeof(T) == 2 ? 1
+                               : sizeof(T) == 4 ? 2
+                                                : 3;
+  if constexpr (std::is_floating_point_v<T>) {
+    return 80 + (little_endian() ? 4 : 0) + ll - 1;
+  } else {
+    return 64 + (std::is_signed_v<T> ? 8 : 0) +
+           (sizeof(T) > 1 && little_endian() ? 4 : 0) + ll;
+  }
+}
+
+/// Load an unsigned integer of `size` bytes in either byte order
+inline std::uint64_t load_bits(const char *p, std::size_t size, bool little) {
+  std::uint64_t v = 0;
+  for (std::size_t i = 0; i < size; ++i) {
+    v = (v << 8) | static_cast<unsigned char>(p[little ? size - 1 - i : i]);
+  }
+  return v;
+}
+
+/// Decode the elements of a typed array into `out`, which has room for all
+/// of them
+///
+/// Elements with the layout of T are copied at once. Others are converted
+/// one by one like single values: integers to any number type if they fit,
+/// floats to floats only.
+template <typename T>
+bool load_typed(std::string_view bytes, const TypedArray &type, T *out) {
+  constexpr bool is_float = std::is_floating_point_v<T>;
+  if (type.is_float == is_float && type.size == sizeof(T) &&
+      (is_float || type.is_signed == std::is_signed_v<T>)) {
+    if (bytes.empty()) {
+      return true;
+    }
+    std::memcpy(out, bytes.data(), bytes.size());
+    if (type.little != little_endian()) {
+      byteswap_all<sizeof(T)>(out, bytes.size() / sizeof(T));
+    }
+    return true;
+  }
+  if (type.is_float && !is_float) {
+    return false;
+  }
+
+  const auto n = bytes.size() / type.size;
+  for (std::size_t i = 0; i < n; ++i) {
+    auto bits = load_bits(bytes.data() + i * type.size, type.size, type.little);
+    if (type.is_float) {
+      out[i] = static_cast<T>(
+          type.size == 4
+              ? bit_cast<float>(static_cast<std::uint32_t>(bits))
+              : bit_cast<double>(bits));
+      continue;
+    }
+    const auto width = 8 * type.size;
+    const bool negative = type.is_signed && (bits >> (width - 1)) & 1;
+    if (negative && width < 64) {
+      bits |= ~std::uint64_t(0) << width;
+    }
+    const StreamInteger v{bits, negative};
+    if constexpr (is_float) {
+      out[i] = to_float<T>(v);
+    } else if (!fit_integer(v, out[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename R, typename = void>
+struct has_read_bulk : std::false_type {};
+template <typename R>
+struct has_read_bulk<R, std::void_t<decltype(std::declval<R &>().read_bulk(
+                            std::declval<TypedArray &>(),
+                            std::declval<std::string_view &>()))>>
+    : std::true_type {};
+
+template <typename W, typename T, typename = void>
+struct has_write_bulk : std::false_type {};
+template <typename W, typename T>
+struct has_write_bulk<W, T,
+                      std::void_t<decltype(std::declval<W &>().write_bulk(
+                          std::declval<const T *>(), std::size_t{}))>>
+    : std::true_type {};
+
+/// Read the next value into a contiguous container if it is a typed array
+///
+/// `fit(n, data)` makes room for `n` elements, pointing `data` at them, or
+/// returns false if the container can't hold that many. Returns false if the
+/// reader has no typed arrays or the next value isn't one; the caller then
+/// reads an ordinary array unless the reader failed.
+template <typename T, typename R, typename F> bool read_typed(R &r, F &&fit) {
+  if constexpr (is_typed_element_v<T> && has_read_bulk<R>::value) {
+    TypedArray type;
+    std::string_view bytes;
+    if (!r.read_bulk(type, bytes)) {
+      return false;
+    }
+    T *data = nullptr;
+    if (bytes.size() % type.size != 0) {
+      r.fail("Bad typed array size");
+    } else if (!fit(bytes.size() / type.size, data)) {
+      r.fail("Wrong array size");
+    } else if (!load_typed(bytes, type, data)) {
+      r.fail("Typed array element out of range");
+    }
+    return true;
+  } else {
+    (void)r;
+    (void)fit;
+    return false;
+  }
+}
+
+/// Write a contiguous container as a typed array if the writer has them for
+/// T; false to write an ordinary array instead
+template <typename W, typename T>
+bool write_typed(W &w, const T *data, std::size_t n) {
+  if constexpr (is_typed_element_v<T> && has_write_bulk<W, T>::value) {
+    return w.write_bulk(data, n);
+  } else {
+    (void)w;
+    (void)data;
+    (void)n;
+    return false;
+  }
+}
+
+/// Containers of typed elements stored contiguously
+template <typename C> struct is_typed_vector : std::false_type {};
+template <typename T, typename A>
+struct is_typed_vector<std::vector<T, A>>
+    : std::bool_constant<is_typed_element_v<T>> {};
+
+/// Containers whose elements are read over in place, keeping the capacity of
+/// their strings and containers from one decode to the next
+template <typename C> struct reuses_elements : std::false_type {};
+template <typename T, typename A>
+struct reuses_elements<std::vector<T, A>>
+    : std::bool_constant<!std::is_same_v<T, bool>> {};
+
+template <typename C, typename = void> struct has_reserve : std::false_type {};
+template <typename C>
+struct has_reserve<C, std::void_t<decltype(std::declval<C &>().reserve(0))>>
+    : std::true_type {};
+
+template <typename A> struct is_polymorphic_allocator : std::false_type {};
+#if SERDE_HAS_PMR
+template <typename T>
+struct is_polymorphic_allocator<std::pmr::polymorphic_allocator<T>>
+    : std::true_type {};
+#endif
+
+template <typename C, typename = void>
+struct has_polymorphic_allocator : std::false_type {};
+template <typename C>
+struct has_polymorphic_allocator<C, std::void_t<typename C::allocator_type>>
+    : is_polymorphic_allocator<typename C::allocator_type> {};
+
+template <typename T> struct is_string : std::false_type {};
+template <typename A>
+struct is_string<std::basic_string<char, std::char_traits<char>, A>>
+    : std::true_type {};
+
+/// Construct an element of a container on its memory resource
+///
+/// Only `std::pmr` containers pass their allocator on; the rest value
+/// initialize the element as before.
+template <typename T, typename A, typename... Args>
+T make_element(const A &alloc, Args &&...args) {
+  if constexpr (is_polymorphic_allocator<A>::value &&
+                std::uses_allocator_v<T, A>) {
+    if constexpr (std::is_constructible_v<T, std::allocator_arg_t, const A &,
+                                          Args...>) {
+      return T(std::allocator_arg, alloc, std::forward<Args>(args)...);
+    } else {
+      return T(std::forward<Args>(args)..., alloc);
+    }
+  } else {
+    return T(std::forward<Args>(args)...);
+  }
+}
+
+/// Rebuild a `std::pmr` container about to be overwritten on the memory
+/// resource of the reader
+///
+/// Members of a structure are default constructed on the default resource
+/// before they are read. Replacing the container in place is fine as none of
+/// the standard containers have const or reference members.
+template <typename R, typename C> void adopt_resource(R &r, C &c) {
+#if SERDE_HAS_PMR
+  if constexpr (has_polymorphic_allocator<C>::value) {
+    using A = typename C::allocator_type;
+    if constexpr (std::is_nothrow_move_constructible_v<C>) {
+      const auto resource = r.resource();
+      if (resource && c.get_allocator().resource() != resource) {
+        // Only the move can't throw, so build the replacement first
+        C fresh{A(resource)};
+        c.~C();
+        new (&c) C(std::move(fresh));
+      }
+    }
+  }
+#else
+  (void)r;
+  (void)c;
+#endif
+}
+
+template <typename C> struct SequenceSerde {
+  /// Binary formats may store typed arrays as tagged byte strings
+  static bool accepts(StreamToken token) {
+    return token == StreamToken::Array ||
+           (is_typed_vector<C>::value && token == StreamToken::Binary);
+  }
+
+  template <typename R> static bool read(R &r, C &c) {
+    using T = typename C::value_type;
+
+    if constexpr (is_typed_vector<C>::value) {
+      if (read_typed<T>(r, [&](std::size_t n, T *&data) {
+            c.clear();
+            adopt_resource(r, c);
+            c.resize(n);
+            data = c.data();
+            return true;
+          })) {
+        return !r.failed();
+      }
+      if (r.failed()) {
+        return false;
+      }
+    }
+
+    StreamFrame frame;
+    if (!r.begin_array(frame)) {
+      return false;
+    }
+
+    if constexpr (!reuses_elements<C>::value) {
+      c.clear();
+    }
+    adopt_resource(r, c);
+    if constexpr (has_reserve<C>::value) {
+      if (frame.sized) {
+        // Counts can't be trusted: reserve one element per byte left at
+        // most, about what readers allow of elements taking no bytes
+        c.reserve(std::min(frame.size, r.remaining()));
+      }
+    }
+
+    if constexpr (reuses_elements<C>::value) {
+      std::size_t n = 0;
+      for (; r.next_element(frame); ++n) {
+        if (n == c.size()) {
+          c.push_back(make_element<T>(c.get_allocator()));
+        }
+        if (!StreamSerde<T>::read(r, c[n])) {
+          return false;
+        }
+      }
+      c.erase(c.begin() + n, c.end());
+      return !r.failed();
+    }
+
+    while (r.next_element(frame)) {
+      auto e = make_element<T>(c.get_allocator());
+      if (!StreamSerde<T>::read(r, e)) {
+        return false;
+      }
+      c.insert(c.end(), std::move(e));
+    }
+
+    return !r.failed();
+  }
+
+  template <typename W> static void write(W &w, const C &c) {
+    using T = typename C::value_type;
+
+    if constexpr (is_typed_vector<C>::value) {
+      if (write_typed(w, c.data(), c.size())) {
+        return;
+      }
+    }
+
+    w.begin_array(c.size());
+    for (const auto &e : c) {
+      StreamSerde<T>::write(w, e);
+    }
+    w.end_array();
+  }
+};
+
+template <typename C> struct MapSerde {
+  using K = typename C::key_type;
+  using V = typename C::mapped_type;
+
+  static bool accepts(StreamToken token) {
+    return token ==
+           (is_string<K>::value ? StreamToken::Object : StreamToken::Array);
+  }
+
+  template <typename R> static bool read(R &r, C &c) {
+    StreamFrame frame;
+    c.clear();
+    adopt_resource(r, c);
+
+    if constexpr (is_string<K>::value) {
+      if (!r.begin_object(frame)) {
+        return false;
+      }
+
+      std::string_view key;
+      while (r.next_key(frame, key)) {
+        auto v = make_element<V>(c.get_allocator());
+        auto k = make_element<K>(c.get_allocator(), key);
+        if (!StreamSerde<V>::read(r, v)) {
+          return false;
+        }
+        c.insert_or_assign(std::move(k), std::move(v));
+      }
+    } else {
+      // Maps with non-string keys are sequences of key-value pairs
+      if (!r.begin_array(frame)) {
+        return false;
+      }
+
+      while (r.next_element(frame)) {
+        std::pair<K, V> kv{};
+        if (!StreamSerde<std::pair<K, V>>::read(r, kv)) {
+          return false;
+        }
+        c.insert_or_assign(std::move(kv.first), std::move(kv.second));
+      }
+    }
+
+    return !r.failed();
+  }
+
+  template <typename W> static void write(W &w, const C &c) {
+    if constexpr (is_string<K>::value) {
+      w.begin_object(c.size());
+      for (auto &[k, v] : c) {
+        w.write_key(k);
+        StreamSerde<V>::write(w, v);
+      }
+      w.end_object();
+    } else {
+      w.begin_array(c.size());
+      for (auto &[k, v] : c) {
+        w.begin_array(2);
+        StreamSerde<K>::write(w, k);
+        StreamSerde<V>::write(w, v);
+        w.end_array();
+      }
+      w.end_array();
+    }
+  }
+};
+
+template <typename R, typename T>
+bool read_element(R &r, StreamFrame &frame, T &v) {
+  if (!r.next_element(frame)) {
+    return r.fail("Too few elements");
+  }
+  return StreamSerde<T>::read(r, v);
+}
+
+template <typename R> bool end_elements(R &r, StreamFrame &frame) {
+  if (r.next_element(frame)) {
+    return r.fail("Too many elements");
+  }
+  return !r.failed();
+}
+
+template <typename R, typename... T, std::size_t... I>
+bool read_tuple(R &r, std::tuple<T...> &t, std::index_sequence<I...>) {
+  StreamFrame frame;
+  return r.begin_array(frame) &&
+         (read_element(r, frame, std::get<I>(t)) && ...) &&
+         end_elements(r, frame);
+}
+
+template <typename W, typename... T, std::size_t... I>
+void write_tuple(W &w, const std::tuple<T...> &t, std::index_sequence<I...>) {
+  w.begin_array(sizeof...(T));
+  (StreamSerde<T>::write(w, std::get<I>(t)), ...);
+  w.end_array();
+}
+
+template <typename T, typename = int> struct has_accepts : std::false_type {};
+template <typename T>
+struct has_accepts<T, decltype((void)StreamSerde<T>::accepts(StreamToken{}),
+                               0)> : std::true_type {};
+
+/// Whether a value starting with the token may decode as T
+///
+/// Lets variants skip alternatives without trying them. Serializers without
+/// `accepts` are always tried.
+template <typename T> bool accepts(StreamToken token) {
+  if constexpr (has_accepts<T>::value) {
+    return StreamSerde<T>::accepts(token);
+  } else {
+    return true;
+  }
+}
+
+} // namespace internal
+
+/// Types without a stream implementation are decoded through the Node of the
+/// language
+template <typename T, typename> struct StreamSerde {
+  template <typename R> static bool read(R &r, T &v) { return r.fallback(v); }
+
+  template <typename W> static void write(W &w, const T &v) { w.fallback(v); }
+};
+
+template <typename T>
+struct StreamSerde<T, std::enable_if_t<std::is_arithmetic_v<T>>> {
+  static bool accepts(StreamToken token) {
+    if constexpr (std::is_same_v<T, bool>) {
+      return token == StreamToken::Bool;
+    } else {
+      return token == StreamToken::Integer || token == StreamToken::Float;
+    }
+  }
+
+  template <typename R> static bool read(R &r, T &v) {
+    if constexpr (std::is_same_v<T, bool>) {
+      return r.read_bool(v);
+    } else if constexpr (std::is_integral_v<T>) {
+      return r.read_integer(v);
+    } else {
+      return r.read_float(v);
+    }
+  }
+
+  template <typename W> static void write(W &w, T v) {
+    if constexpr (std::is_same_v<T, bool>) {
+      w.write_bool(v);
+    } else if constexpr (std::is_integral_v<T>) {
+      w.write_integer(v);
+    } else {
+      w.write_float(v);
+    }
+  }
+};
+
+/// Enums without SERDE_ADD_ENUM are numbers
+template <typename T>
+struct StreamSerde<
+    T, std::enable_if_t<std::is_enum_v<T> && !is_serde_specialized_v<T>>> {
+  static bool accepts(StreamToken token) {
+    return token == StreamToken::Integer;
+  }
+
+  template <typename R> static bool read(R &r, T &v) {
+    std::underlying_type_t<T> u{};
+    if (!r.read_integer(u)) {
+      return false;
+    }
+    v = static_cast<T>(u);
+    return true;
+  }
+
+  template <typename W> static void write(W &w, T v) {
+    w.write_integer(static_cast<std::underlying_type_t<T>>(v));
+  }
+};
+
+/// Enums with SERDE_ADD_ENUM are names
+template <typename T>
+struct StreamSerde<
+    T, std::enable_if_t<std::is_enum_v<T> && is_serde_specialized_v<T>>> {
+  static bool accepts(StreamToken token) {
+    return token == StreamToken::String;
+  }
+
+  template <typename R> static bool read(R &r, T &v) {
+    const auto mark = r.mark();
+    std::string_view name;
+    std::string escaped;
+    if (!r.view_string(name)) {
+      // Only names stored escaped or in chunks need a copy
+      r.reset(mark);
+      if (!r.read_string(escaped)) {
+        return false;
+      }
+      name = escaped;
+    }
+    const auto value = internal::enum_table_v<T>.value(name);
+    if (!value) {
+      r.reset(mark);
+      return r.fail_copy("Bad enum value", std::string(name));
+    }
+    v = value.value();
+    return true;
+  }
+
+  template <typename W> static void write(W &w, T v) {
+    const auto name = internal::enum_table_v<T>.name(v);
+    if (name.empty()) {
+      w.fail("Bad enum value");
+      return;
+    }
+    w.write_string(name);
+  }
+};
+
+template <typename A>
+struct StreamSerde<std::basic_string<char, std::char_traits<char>, A>> {
+  using S = std::basic_string<char, std::char_traits<char>, A>;
+
+  static bool accepts(StreamToken token) {
+    return token == StreamToken::String;
+  }
+
+  template <typename R> static bool read(R &r, S &v) {
+    if constexpr (std::is_same_v<S, std::string>) {
+      return r.read_string(v);
+    } else {
+      // Readers decode into std::string; copy only strings stored escaped
+      // or in chunks
+      internal::adopt_resource(r, v);
+      const auto mark = r.mark();
+      std::string_view view;
+      if (r.view_string(view)) {
+        v.assign(view.data(), view.size());
+        return true;
+      }
+      r.reset(mark);
+      std::string escaped;
+      if (!r.read_string(escaped)) {
+        return false;
+      }
+      v.assign(escaped.data(), escaped.size());
+      return true;
+    }
+  }
+
+  template <typename W> static void write(W &w, const S &v) {
+    w.write_string(v);
+  }
+};
+
+/// Views refer into the input, which must outlive them
+template <> struct StreamSerde<std::string_view> {
+  static bool accepts(StreamToken token) {
+    return token == StreamToken::String;
+  }
+
+  template <typename R> static bool read(R &r, std::string_view &v) {
+    return r.view_string(v);
+  }
+
+  template <typename W> static void write(W &w, std::string_view v) {
+    w.write_string(v);
+  }
+};
+
+template <typename T> struct StreamSerde<std::optional<T>> {
+  static bool accepts(StreamToken token) {
+    return token == StreamToken::Null || internal::accepts<T>(token);
+  }
+
+  template <typename R> static bool read(R &r, std::optional<T> &v) {
+    if (r.peek() == StreamToken::Null) {
+      v.reset();
+      return r.read_null();
+    }
+    if (!v) {
+      v.emplace();
+    }
+    return StreamSerde<T>::read(r, *v);
+  }
+
+  template <typename W> static void write(W &w, const std::optional<T> &v) {
+    if (v) {
+      StreamSerde<T>::write(w, *v);
+    } else {
+      w.write_null();
+    }
+  }
+};
+
+template <typename T, typename A>
+struct StreamSerde<std::vector<T, A>>
+    : internal::SequenceSerde<std::vector<T, A>> {};
+
+template <typename T, typename A>
+struct StreamSerde<std::deque<T, A>>
+    : internal::SequenceSerde<std::deque<T, A>> {};
+
+template <typename T, typename A>
+struct StreamSerde<std::list<T, A>> : internal::SequenceSerde<std::list<T, A>> {
+};
+
+template <typename T, typename C, typename A>
+struct StreamSerde<std::set<T, C, A>>
+    : internal::SequenceSerde<std::set<T, C, A>> {};
+
+template <typename T, typename H, typename E, typename A>
+struct StreamSerde<std::unordered_set<T, H, E, A>>
+    : internal::SequenceSerde<std::unordered_set<T, H, E, A>> {};
+
+template <typename K, typename V, typename C, typename A>
+struct StreamSerde<std::map<K, V, C, A>>
+    : internal::MapSerde<std::map<K, V, C, A>> {};
+
+template <typename K, typename V, typename H, typename E, typename A>
+struct StreamSerde<std::unordered_map<K, V, H, E, A>>
+    : internal::MapSerde<std::unordered_map<K, V, H, E, A>> {};
+
+template <typename T, std::size_t N> struct StreamSerde<std::array<T, N>> {
+  static bool accepts(StreamToken token) {
+    return token == StreamToken::Array ||
+           (internal::is_typed_element_v<T> && token == StreamToken::Binary);
+  }
+
+  template <typename R> static bool read(R &r, std::array<T, N> &v) {
+    if (internal::read_typed<T>(r, [&](std::size_t n, T *&data) {
+          data = v.data();
+          return n == N;
+        })) {
+      return !r.failed();
+    }
+    if (r.failed()) {
+      return false;
+    }
+
+    StreamFrame frame;
+    if (!r.begin_array(frame)) {
+      return false;
+    }
+    for (auto &e : v) {
+      if (!internal::read_element(r, frame, e)) {
+        return false;
+      }
+    }
+    return internal::end_elements(r, frame);
+  }
+
+  template <typename W> static void write(W &w, const std::array<T, N> &v) {
+    if (internal::write_typed(w, v.data(), N)) {
+      return;
+    }
+    w.begin_array(N);
+    for (auto &e : v) {
+      StreamSerde<T>::write(w, e);
+    }
+    w.end_array();
+  }
+};
+
+template <typename T, typename U> struct StreamSerde<std::pair<T, U>> {
+  static bool accepts(StreamToken token) {
+    return token == StreamToken::Array;
+  }
+
+  template <typename R> static bool read(R &r, std::pair<T, U> &v) {
+    StreamFrame frame;
+    return r.begin_array(frame) &&
+           internal::read_element(r, frame, v.first) &&
+           internal::read_element(r, frame, v.second) &&
+           internal::end_elements(r, frame);
+  }
+
+  template <typename W> static void write(W &w, const std::pair<T, U> &v) {
+    w.begin_array(2);
+    StreamSerde<T>::write(w, v.first);
+    StreamSerde<U>::write(w, v.second);
+    w.end_array();
+  }
+};
+
+template <typename... T> struct StreamSerde<std::tuple<T...>> {
+  static bool accepts(StreamToken token) {
+    return token == StreamToken::Array;
+  }
+
+  template <typename R> static bool read(R &r, std::tuple<T...> &v) {
+    return internal::read_tuple(r, v, std::index_sequence_for<T...>{});
+  }
+
+  template <typename W> static void write(W &w, const std::tuple<T...> &v) {
+    internal::write_tuple(w, v, std::index_sequence_for<T...>{});
+  }
+};
+
+/// Untagged variants take the first alternative that decodes, as in the Node
+/// based converters, skipping those that can't start with the next token.
+/// Variants with SERDE_ADD_VARIANT/SERDE_ADD_VARIANT_TAG dispatch on the name.
+template <typename... T> struct StreamSerde<std::variant<T...>> {
+  using V = std::variant<T...>;
+
+  static bool accepts(StreamToken token) {
+    if constexpr (internal::is_tagged_variant<V>::value) {
+      return token == StreamToken::Object;
+    } else {
+      return (internal::accepts<T>(token) || ...);
+    }
+  }
+
+  template <typename R> static bool read(R &r, V &v) {
+    if constexpr (internal::is_tagged_variant<V>::value) {
+      if (VariantTags<V>::tag.empty()) {
+        return read_external(r, v);
+      } else {
+        return read_internal(r, v);
+      }
+    } else {
+      const auto mark = r.mark();
+      const auto token = r.peek();
+      if ((try_read<T>(r, v, mark, token) || ...)) {
+        return true;
+      }
+      return r.fail("Variant didn't match");
+    }
+  }
+
+  template <typename W> static void write(W &w, const V &v) {
+    std::visit(
+        [&](auto &alt) {
+          using U = std::decay_t<decltype(alt)>;
+          if constexpr (internal::is_tagged_variant<V>::value) {
+            const auto name = VariantTags<V>::names.name(v.index());
+            if (VariantTags<V>::tag.empty()) {
+              w.begin_object(1);
+              w.write_key(name);
+              StreamSerde<U>::write(w, alt);
+              w.end_object();
+            } else {
+              static_assert(is_serde_record_v<U>,
+                            "Alternatives of a variant with "
+                            "SERDE_ADD_VARIANT_TAG must be structures");
+              StreamSerde<U>::write_tagged(w, alt, VariantTags<V>::tag, name);
+            }
+          } else {
+            StreamSerde<U>::write(w, alt);
+          }
+        },
+        v);
+  }
+
+private:
+  template <typename U, typename R, typename M>
+  static bool try_read(R &r, V &v, M mark, StreamToken token) {
+    if (!internal::accepts<U>(token)) {
+      return false;
+    }
+    U alt{};
+    if (StreamSerde<U>::read(r, alt)) {
+      v = std::move(alt);
+      return true;
+    }
+    r.reset(mark);
+    return false;
+  }
+
+  template <typename R>
+  static bool read_alternative(R &r, V &v, std::size_t i) {
+    return internal::with_alternative(v, i, [&](auto &alt) {
+      return StreamSerde<std::decay_t<decltype(alt)>>::read(r, alt);
+    });
+  }
+
+  /// {"name": value}
+  template <typename R> static bool read_external(R &r, V &v) {
+    StreamFrame frame;
+    std::string_view key;
+    if (!r.begin_object(frame) || !r.next_key(frame, key)) {
+      return r.fail("Expected variant name");
+    }
+    const auto i = VariantTags<V>::names.find(key);
+    if (i == sizeof...(T)) {
+      return r.fail_copy("Bad variant name", std::string(key));
+    }
+    if (!read_alternative(r, v, i)) {
+      return false;
+    }
+    if (r.next_key(frame, key) || r.failed()) {
+      return r.fail("Expected one member in variant");
+    }
+    return true;
+  }
+
+  /// {"tag": "name", ...}; the tag doesn't have to come first
+  template <typename R> static bool read_internal(R &r, V &v) {
+    const auto mark = r.mark();
+    StreamFrame frame;
+    if (!r.begin_object(frame)) {
+      return false;
+    }
+    std::string_view key;
+    while (r.next_key(frame, key)) {
+      if (key != VariantTags<V>::tag) {
+        if (!r.skip()) {
+          return false;
+        }
+        continue;
+      }
+      std::string name;
+      if (!r.read_string(name)) {
+        return false;
+      }
+      const auto i = VariantTags<V>::names.find(name);
+      if (i == sizeof...(T)) {
+        return r.fail_copy("Bad variant name", std::move(name));
+      }
+      // The alternative reads the whole object and skips the tag
+      r.reset(mark);
+      return internal::with_alternative(v, i, [&](auto &alt) {
+        return StreamSerde<std::decay_t<decltype(alt)>>::read(
+            r, alt, nullptr, VariantTags<V>::tag);
+      });
+    }
+    return r.fail("Missing variant tag", VariantTags<V>::tag);
+  }
+};
+
+/// Subset of the members of a structure to decode
+///
+/// Members left out are skipped over in the input as unknown ones are, and
+/// keep their value in the object. Those listed must be present unless they
+/// have a default:
+///
+///   const serde::Projection<Trade> columns{"price", "size"};
+///   auto trade = serde::from_bytes<serde::JSON>(bytes, columns);
+template <typename T> class Projection {
+  static_assert(is_serde_record_v<T>,
+                "Projections are of structures with SERDE_DEFINE");
+  static constexpr auto size = internal::field_index_v<T>.size();
+
+public:
+  Projection(std::initializer_list<std::string_view> names) {
+    for (const auto name : names) {
+      const auto i = internal::field_index_v<T>.find(name);
+      if (i != size) {
+        m_wanted[i] = true;
+      } else if (m_unknown.empty()) {
+        m_unknown = name;
+      }
+    }
+  }
+
+  /// True if the i-th member is decoded
+  bool has(std::size_t i) const { return m_wanted[i]; }
+
+  /// First name given that isn't a member, if any
+  const std::string &unknown() const { return m_unknown; }
+
+private:
+  std::array<bool, size> m_wanted{};
+  std::string m_unknown;
+};
+
+namespace internal {
+
+template <typename W, typename = void>
+struct has_encoded_keys : std::false_type {};
+template <typename W>
+struct has_encoded_keys<
+    W, std::void_t<decltype(std::declval<W &>().write_encoded_key(
+           std::string_view{}))>> : std::true_type {};
+
+template <typename W, typename = void>
+struct has_write_key_id : std::false_type {};
+template <typename W>
+struct has_write_key_id<
+    W, std::void_t<decltype(std::declval<W &>().write_key_id(std::size_t{}))>>
+    : std::true_type {};
+
+template <typename R, typename = void>
+struct has_next_key_id : std::false_type {};
+template <typename R>
+struct has_next_key_id<
+    R, std::void_t<decltype(std::declval<R &>().next_key_id(
+           std::declval<StreamFrame &>(), std::declval<std::string_view &>(),
+           std::declval<std::optional<std::size_t> &>()))>>
+    : std::true_type {};
+
+/// Member keys of T as written by W, encoded once on first use
+///
+/// Each is what `write_key`, or `write_key_id` if `by_id`, appends as the
+/// first key of a fresh writer, e.g. `"name":` in JSON or the string header
+/// and name in MsgPack, so writing a structure copies its keys instead of
+/// encoding them again.
+template <typename W, typename T, bool by_id> const auto &encoded_keys() {
+  static const auto keys = [] {
+    constexpr auto &index = field_index_v<T>;
+    std::array<std::string, index.size()> keys;
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+      W w(keys[i]);
+      if constexpr (by_id) {
+        w.write_key_id(MemberIds<T>::ids.id(i));
+      } else {
+        w.write_key(index.name(i));
+      }
+    }
+    return keys;
+  }();
+  return keys;
+}
+
+} // namespace internal
+
+/// Structures are coded member by member in place
+template <typename T>
+struct StreamSerde<T, std::enable_if_t<is_serde_record_v<T>>> {
+  static bool accepts(StreamToken token) {
+    return token == StreamToken::Object;
+  }
+
+  template <typename R> static bool read(R &r, T &obj) {
+    return read(r, obj, nullptr);
+  }
+
+  /// Read the members of `only`, if given, skipping the others and the
+  /// member `tag` naming the alternative of a variant
+  template <typename R>
+  static bool read(R &r, T &obj, const Projection<T> *only,
+                   std::string_view tag = {}) {
+    auto members = CoreHandler<T>::fields(obj);
+    std::array<bool, std::tuple_size_v<decltype(members)>> seen{};
+
+    StreamFrame frame;
+    if (!r.begin_object(frame)) {
+      return false;
+    }
+
+    std::size_t i;
+    while (next_member(r, frame, i, tag)) {
+      if (i == seen.size() || (only && !only->has(i))) {
+        if (!r.skip()) {
+          return false;
+        }
+        continue;
+      }
+      seen[i] = true;
+      if (!internal::visit_member(members, i, [&](auto &mem, auto) {
+            return StreamSerde<std::decay_t<decltype(mem.value)>>::read(
+                r, mem.value);
+          })) {
+        return false;
+      }
+    }
+    if (r.failed()) {
+      return false;
+    }
+
+    return !internal::any_member(members, [&](auto &mem, auto i) {
+      if (seen[i] || (only && !only->has(i))) {
+        return false;
+      }
+      if constexpr (std::decay_t<decltype(mem)>::has_default) {
+        internal::adopt_resource(r, mem.value);
+        mem.value = mem.make_default();
+        return false;
+      } else {
+        return !r.fail("Node member doesn't have value", mem.name);
+      }
+    });
+  }
+
+  template <typename W> static void write(W &w, const T &obj) {
+    write_tagged(w, obj, {}, {});
+  }
+
+  /// Index of the member of the next key, or the number of members if it
+  /// isn't one; fails on such keys other than `tag` if T denies unknown
+  /// members
+  template <typename R>
+  static bool next_member(R &r, StreamFrame &frame, std::size_t &i,
+                          std::string_view tag) {
+    constexpr auto &index = internal::field_index_v<T>;
+    std::string_view key;
+    std::optional<std::size_t> id;
+    if constexpr (internal::has_member_ids<T>::value &&
+                  internal::has_next_key_id<R>::value) {
+      if (!r.next_key_id(frame, key, id)) {
+        return false;
+      }
+      i = id ? MemberIds<T>::ids.find(*id) : index.find(key);
+    } else {
+      if (!r.next_key(frame, key)) {
+        return false;
+      }
+      i = index.find(key);
+    }
+    if (DenyUnknown<T>::value && i == index.size() &&
+        (id || tag.empty() || key != tag)) {
+      return r.fail_copy("Unknown member",
+                         id ? std::to_string(*id) : std::string(key));
+    }
+    return true;
+  }
+
+  /// Write with an extra first member holding the name of a variant
+  /// alternative, unless `tag` is empty
+  ///
+  /// Members are keyed by their ids if T has some and the writer is of a
+  /// binary format, except next to a tag, which is read back by name.
+  template <typename W>
+  static void write_tagged(W &w, const T &obj, std::string_view tag,
+                           std::string_view name) {
+    constexpr bool ids = internal::has_member_ids<T>::value &&
+                         internal::has_write_key_id<W>::value &&
+                         internal::has_encoded_keys<W>::value;
+    auto members = CoreHandler<T>::fields(obj);
+
+    w.begin_object(std::tuple_size_v<decltype(members)> + !tag.empty());
+    if (!tag.empty()) {
+      w.write_key(tag);
+      w.write_string(name);
+    }
+    internal::any_member(members, [&](auto &mem, auto i) {
+      if constexpr (internal::has_encoded_keys<W>::value) {
+        const auto &keys = ids && tag.empty()
+                               ? internal::encoded_keys<W, T, ids>()
+                               : internal::encoded_keys<W, T, false>();
+        w.write_encoded_key(keys[i]);
+      } else {
+        w.write_key(mem.name);
+      }
+      StreamSerde<std::decay_t<decltype(mem.value)>>::write(w, mem.value);
+      return false;
+    });
+    w.end_object();
+  }
+};
+
+/// How the records of a stream are delimited
+enum class Framing {
+  /// Values one after another: newline-delimited or concatenated JSON, or
+  /// concatenated MsgPack, CBOR or UBJSON values
+  Concatenated,
+  /// Each value preceded by its size in bytes as a 32-bit big-endian integer
+  LengthPrefixed,
+};
+
+/// Decoder of a sequence of records of type T from one buffer
+///
+/// One stream reader and its scratch buffers serve every record, and `next`
+/// decodes into the object it is given, so the strings and containers of a
+/// reused object keep their capacity from one record to the next. Iterating
+/// yields such an object owned by the reader:
+///
+///   RecordReader<JSON, Line> records(input);
+///   for (auto &line : records) {
+///     ...
+///   }
+///   if (records.failed()) {
+///     ... records.error().message() ...
+///   }
+///
+/// Decoding stops at the first malformed record.
+template <typename Lang, typename T> class RecordReader {
+  static_assert(internal::has_reader<Lang, T>::value,
+                "Records need a language with a stream reader and a default "
+                "constructible type");
+
+public:
+  explicit RecordReader(std::string_view input,
+                        Framing framing = Framing::Concatenated)
+      : m_reader(input), m_framing(framing) {}
+
+  /// Decode the records in `[begin, end)` of the input only, reporting errors
+  /// at their offset in the whole input
+  RecordReader(std::string_view input, std::size_t begin, std::size_t end,
+               Framing framing = Framing::Concatenated)
+      : m_reader(input), m_framing(framing) {
+    m_reader.narrow(begin, end);
+  }
+
+  /// Decode only the members of `only`, which must outlive the reader
+  template <typename U = T, typename = std::enable_if_t<is_serde_record_v<U>>>
+  RecordReader(std::string_view input, const Projection<U> &only,
+               Framing framing = Framing::Concatenated)
+      : m_reader(input), m_framing(framing), m_only(&only) {
+    if (!only.unknown().empty()) {
+      m_reader.fail_copy("Unknown member", only.unknown());
+    }
+  }
+
+  /// Decode the next record into `obj`; false at the end or on error
+  bool next(T &obj) {
+    if (m_reader.failed()) {
+      return false;
+    }
+    if (m_framing == Framing::Concatenated) {
+      if (m_reader.at_end() || !read(obj)) {
+        return false;
+      }
+    } else {
+      const char *outer_end;
+      if (m_reader.remaining() == 0 || !m_reader.enter_record(outer_end)) {
+        return false;
+      }
+      const bool ok = read(obj) && m_reader.finish();
+      m_reader.leave_record(outer_end);
+      if (!ok) {
+        return false;
+      }
+    }
+    ++m_count;
+    return true;
+  }
+
+  bool failed() const { return m_reader.failed(); }
+
+  /// Error of the record that failed, at its offset in the whole input
+  const Error &error() const { return m_reader.error(); }
+
+  /// Number of records decoded so far
+  std::size_t count() const { return m_count; }
+
+  class iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T *;
+    using reference = T &;
+
+    iterator() = default;
+
+    explicit iterator(RecordReader *records) : m_records(records) {
+      ++*this;
+    }
+
+    T &operator*() const { return m_records->m_record; }
+
+    T *operator->() const { return &m_records->m_record; }
+
+    iterator &operator++() {
+      if (!m_records->next(m_records->m_record)) {
+        m_records = nullptr;
+      }
+      return *this;
+    }
+
+    bool operator==(const iterator &other) const {
+      return m_records == other.m_records;
+    }
+
+    bool operator!=(const iterator &other) const { return !(*this == other); }
+
+  private:
+    RecordReader *m_records = nullptr;
+  };
+
+  iterator begin() { return iterator(this); }
+
+  iterator end() { return iterator(); }
+
+private:
+  bool read(T &obj) {
+    if constexpr (is_serde_record_v<T>) {
+      return StreamSerde<T>::read(m_reader, obj, m_only);
+    } else {
+      return StreamSerde<T>::read(m_reader, obj);
+    }
+  }
+
+  typename LangHandler<Lang>::Reader m_reader;
+  Framing m_framing;
+  const Projection<T> *m_only = nullptr;
+  std::size_t m_count = 0;
+  T m_record{};
+};
+
+/// Decode only the members of `only` of a structure
+template <typename Lang, typename T>
+Result<T> from_bytes(std::string_view bytes, const Projection<T> &only) {
+  static_assert(internal::has_reader<Lang, T>::value,
+                "Projections need a language with a stream reader and a "
+                "default constructible type");
+  typename LangHandler<Lang>::Reader reader(bytes);
+  T obj{};
+  if (!only.unknown().empty()) {
+    reader.fail_copy("Unknown member", only.unknown());
+  } else if (StreamSerde<T>::read(reader, obj, &only) && reader.finish()) {
+    return Result<T>::value(std::move(obj));
+  }
+  auto err = reader.error();
+  err.context("parsing bytes");
+  return Result<T>::error(std::move(err));
+}
+
+/// Decode each record of a buffer and pass it to `f`
+///
+/// `f` takes a `T &`, which it may move from, and returns nothing or false to
+/// stop early. The object is reused for every record. Returns the number of
+/// records decoded.
+template <typename Lang, typename T, typename F>
+Result<std::size_t>
+records_from_bytes(std::string_view bytes, F &&f,
+                   Framing framing = Framing::Concatenated) {
+  RecordReader<Lang, T> records(bytes, framing);
+  T obj{};
+  while (records.next(obj)) {
+    if constexpr (std::is_same_v<decltype(f(obj)), bool>) {
+      if (!f(obj)) {
+        break;
+      }
+    } else {
+      f(obj);
+    }
+  }
+  if (records.failed()) {
+    auto err = records.error();
+    err.context("parsing records");
+    return Result<std::size_t>::error(std::move(err));
+  }
+  return Result<std::size_t>::value(records.count());
+}
+
+/// Decode each record of a file and pass it to `f`
+///
+/// The file is mapped into memory rather than read line by line.
+template <typename Lang, typename T, typename F>
+Result<std::size_t>
+records_from_file(const std::string &filename, F &&f,
+                  Framing framing = Framing::Concatenated) {
+  const auto contents = internal::read_file(filename);
+  if (!contents) {
+    return Result<std::size_t>::error(
+        "serde: on parsing records: file not found: " + filename);
+  }
+  return records_from_bytes<Lang, T>(contents->view(), std::forward<F>(f),
+                                     framing);
+}
+
+} // namespace serde
+
+#endif // SERDE_STREAM_H_
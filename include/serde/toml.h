@@ -147,7 +147,12 @@ template <typename K, typename V> struct TomlSerde<std::map<K, V>> {
 
 template <> struct LangHandler<TOML> {
   static Node<TOML> from_string(const std::string &str) {
-    auto is = std::istringstream(str);
+    return from_bytes(str);
+  }
+
+  static Node<TOML> from_bytes(std::string_view bytes) {
+    internal::ViewStreamBuf buf(bytes);
+    std::istream is(&buf);
     auto p = cpptoml::parser(is);
     return Node<TOML>{std::static_pointer_cast<cpptoml::base>(p.parse())};
   }
@@ -170,32 +175,45 @@ template <> struct LangHandler<TOML> {
   static T unpack_struct(const Node<TOML> &node, Member<Args>... args) {
     auto table = node.base->as_table();
 
-    auto unpack_member = [&](const auto &mem) {
-      if (!table->contains(mem.name)) {
-        if (mem.value) {
-          return mem.value.value();
+    // Match each key of the input to its member once
+    std::array<Base, sizeof...(Args)> slots;
+    for (const auto &kv : *table) {
+      const auto i = internal::field_index_v<T>.find(kv.first);
+      if (i < slots.size()) {
+        slots[i] = kv.second;
+      } else if (DenyUnknown<T>::value) {
+        throw Exception("Unknown member: " + kv.first);
+      }
+    }
+
+    return unpack_slots<T>(slots, std::index_sequence_for<Args...>{},
+                           args...);
+  }
+
+  template <typename T, std::size_t... I, typename... Args>
+  static T unpack_slots(const std::array<Base, sizeof...(Args)> &slots,
+                        std::index_sequence<I...>, Member<Args>... args) {
+    auto unpack_member = [&](const Base &b, auto &mem) {
+      if (!b) {
+        if (mem.make_default) {
+          return mem.make_default();
         } else {
           throw Exception("Node member doesn't have value: " +
                           std::string(mem.name));
         }
       }
-      auto b = table->get(mem.name);
-      return dec<std::decay_t<decltype(mem.value.value())>>(b);
+      return dec<typename std::decay_t<decltype(mem)>::type>(b);
     };
 
-    return T{unpack_member(args)...};
+    return T{unpack_member(slots[I], args)...};
   }
 
   template <typename T, typename... Args>
-  static Node<TOML> pack_struct(Member<Args>... args) {
+  static Node<TOML> pack_struct(MemberRef<const Args>... args) {
     auto table = cpptoml::make_table();
 
     auto push_member = [&](auto &mem) {
-      if (!mem.value) {
-        throw Exception("Logic error: " + std::string(mem.name));
-      }
-
-      table->insert(mem.name, enc(mem.value.value()));
+      table->insert(mem.name, enc(mem.value));
     };
 
     (push_member(args), ...);
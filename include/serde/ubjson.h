@@ -9,19 +9,750 @@ struct UBJSON;
 
 template <> struct Node<UBJSON> { json j; };
 
+/// Pull reader decoding UBJSON straight into objects
+///
+/// Elements of a container with a type (`$`) have no marker of their own;
+/// `next_element`/`next_key` make it pending for the next read.
+class UbjsonReader : public StreamReader {
+public:
+  using StreamReader::StreamReader;
+
+  /// Position to backtrack to
+  struct Mark {
+    StreamReader::Mark base;
+    char pending;
+  };
+
+  Mark mark() const { return Mark{StreamReader::mark(), m_pending}; }
+
+  void reset(Mark mark) {
+    StreamReader::reset(mark.base);
+    m_pending = mark.pending;
+  }
+
+  StreamToken peek() {
+    char marker;
+    if (!peek_marker(marker)) {
+      return StreamToken::End;
+    }
+    switch (marker) {
+    case 'Z':
+      return StreamToken::Null;
+    case 'T':
+    case 'F':
+      return StreamToken::Bool;
+    case 'i':
+    case 'U':
+    case 'I':
+    case 'l':
+    case 'L':
+      return StreamToken::Integer;
+    case 'd':
+    case 'D':
+    case 'H':
+      return StreamToken::Float;
+    case 'C':
+    case 'S':
+      return StreamToken::String;
+    case '[':
+      return StreamToken::Array;
+    case '{':
+      return StreamToken::Object;
+    default:
+      return StreamToken::Invalid;
+    }
+  }
+
+  bool read_null() {
+    const auto mark = this->mark();
+    char marker;
+    if (!take_marker(marker) || marker != 'Z') {
+      reset_to(mark);
+      return fail("Expected null");
+    }
+    return true;
+  }
+
+  bool read_bool(bool &v) {
+    const auto mark = this->mark();
+    char marker;
+    if (!take_marker(marker) || (marker != 'T' && marker != 'F')) {
+      reset_to(mark);
+      return fail("Expected boolean");
+    }
+    v = marker == 'T';
+    return true;
+  }
+
+  template <typename I> bool read_integer(I &v) {
+    const auto mark = this->mark();
+    char marker;
+    if (!take_marker(marker)) {
+      return false;
+    }
+    if (marker == 'H') {
+      std::string_view digits;
+      if (!read_sized(digits)) {
+        return false;
+      }
+      const auto [ptr, ec] =
+          std::from_chars(digits.data(), digits.data() + digits.size(), v);
+      if (ec != std::errc() || ptr != digits.data() + digits.size()) {
+        reset_to(mark);
+        return fail("Expected integer");
+      }
+      return true;
+    }
+    StreamInteger n;
+    if (!read_int(marker, n)) {
+      reset_to(mark);
+      return fail("Expected integer");
+    }
+    if (!internal::fit_integer(n, v)) {
+      reset_to(mark);
+      return fail("Integer out of range");
+    }
+    return true;
+  }
+
+  template <typename F> bool read_float(F &v) {
+    const auto mark = this->mark();
+    char marker;
+    if (!take_marker(marker)) {
+      return false;
+    }
+    if (marker == 'd' && need(4)) {
+      v = static_cast<F>(
+          internal::bit_cast<float>(internal::load_be<std::uint32_t>(m_cur)));
+      m_cur += 4;
+      return true;
+    }
+    if (marker == 'D' && need(8)) {
+      v = static_cast<F>(
+          internal::bit_cast<double>(internal::load_be<std::uint64_t>(m_cur)));
+      m_cur += 8;
+      return true;
+    }
+    if (marker == 'H') {
+      std::string_view digits;
+      if (!read_sized(digits)) {
+        return false;
+      }
+      const auto [ptr, ec] =
+          std::from_chars(digits.data(), digits.data() + digits.size(), v);
+      if (ec == std::errc() && ptr == digits.data() + digits.size()) {
+        return true;
+      }
+    } else {
+      StreamInteger n;
+      if (read_int(marker, n)) {
+        v = internal::to_float<F>(n);
+        return true;
+      }
+    }
+    reset_to(mark);
+    return fail("Expected number");
+  }
+
+  bool read_string(std::string &v) {
+    const auto mark = this->mark();
+    char marker;
+    if (!take_marker(marker)) {
+      return false;
+    }
+    if (marker == 'C' && need(1)) {
+      v.assign(m_cur++, 1);
+      return true;
+    }
+    std::string_view view;
+    if (marker != 'S' || !read_sized(view)) {
+      reset_to(mark);
+      return fail("Expected string");
+    }
+    v.assign(view.data(), view.size());
+    return true;
+  }
+
+  bool view_string(std::string_view &v) {
+    const auto mark = this->mark();
+    char marker;
+    if (!take_marker(marker)) {
+      return false;
+    }
+    if (marker == 'C' && need(1)) {
+      v = std::string_view(m_cur++, 1);
+      return true;
+    }
+    if (marker != 'S' || !read_sized(v)) {
+      reset_to(mark);
+      return fail("Expected string");
+    }
+    return true;
+  }
+
+  bool begin_array(StreamFrame &frame) { return begin(frame, '['); }
+
+  bool next_element(StreamFrame &frame) { return next(frame, ']'); }
+
+  bool begin_object(StreamFrame &frame) { return begin(frame, '{'); }
+
+  bool next_key(StreamFrame &frame, std::string_view &key) {
+    if (!next(frame, '}')) {
+      return false;
+    }
+    // Keys have no marker
+    const auto pending = m_pending;
+    m_pending = 0;
+    if (!read_sized(key)) {
+      return false;
+    }
+    m_pending = pending;
+    return true;
+  }
+
+  /// Next member keyed by name, or by integer id in decimal setting `id`
+  ///
+  /// Keys are always strings in UBJSON; names of members can't start with a
+  /// digit.
+  bool next_key_id(StreamFrame &frame, std::string_view &key,
+                   std::optional<std::size_t> &id) {
+    id.reset();
+    if (!next_key(frame, key)) {
+      return false;
+    }
+    if (key.empty() || key[0] < '0' || key[0] > '9') {
+      return true;
+    }
+    const auto end = key.data() + key.size();
+    std::size_t v;
+    const auto [ptr, ec] = std::from_chars(key.data(), end, v);
+    if (ec == std::errc() && ptr == end) {
+      id = v;
+    }
+    return true;
+  }
+
+  /// Skip a value using the lengths in the headers
+  bool skip() {
+    m_stack.clear();
+    do {
+      if (!m_stack.empty()) {
+        auto &top = m_stack.back();
+        if (top.sized ? top.size == 0 : at(top.end)) {
+          if (!top.sized) {
+            ++m_cur;
+          }
+          m_stack.pop_back();
+          continue;
+        }
+        if (top.sized) {
+          --top.size;
+        }
+        if (top.end == '}') {
+          std::string_view key;
+          if (!read_sized(key)) {
+            return false;
+          }
+        }
+        m_pending = top.type;
+      }
+
+      char marker;
+      if (!take_marker(marker)) {
+        return false;
+      }
+      switch (marker) {
+      case 'Z':
+      case 'T':
+      case 'F':
+        break;
+      case 'i':
+      case 'U':
+      case 'C':
+        if (!advance(1)) {
+          return false;
+        }
+        break;
+      case 'I':
+        if (!advance(2)) {
+          return false;
+        }
+        break;
+      case 'l':
+      case 'd':
+        if (!advance(4)) {
+          return false;
+        }
+        break;
+      case 'L':
+      case 'D':
+        if (!advance(8)) {
+          return false;
+        }
+        break;
+      case 'S':
+      case 'H': {
+        std::string_view s;
+        if (!read_sized(s)) {
+          return false;
+        }
+        break;
+      }
+      case '[':
+      case '{': {
+        StreamFrame frame;
+        if (!read_container(frame)) {
+          return false;
+        }
+        m_stack.push_back(Level{frame.size, frame.sized, frame.type,
+                                marker == '[' ? ']' : '}'});
+        break;
+      }
+      default:
+        return fail("Bad marker");
+      }
+    } while (!m_stack.empty());
+
+    return true;
+  }
+
+  bool finish() {
+    if (failed()) {
+      return false;
+    }
+    return m_cur == m_end || fail("Unexpected trailing bytes");
+  }
+
+  /// View the elements of an array with a numeric type and a count in place
+  bool read_bulk(internal::TypedArray &type, std::string_view &bytes) {
+    const auto mark = this->mark();
+    char marker;
+    if (!peek_marker(marker) || marker != '[') {
+      return false;
+    }
+    take_marker(marker);
+    if (remaining() < 3 || m_cur[0] != '$' || m_cur[2] != '#' ||
+        !typed_array_of_marker(m_cur[1], type)) {
+      reset_to(mark);
+      return false;
+    }
+    m_cur += 3;
+    std::size_t n;
+    if (!read_length(n)) {
+      return false;
+    }
+    if (n > remaining() / type.size) {
+      return fail("Unexpected end of input");
+    }
+    bytes = std::string_view(m_cur, n * type.size);
+    m_cur += bytes.size();
+    return true;
+  }
+
+  /// Decode a value of a type without stream support through the json tree
+  template <typename T> bool fallback(T &v) {
+    const auto mark = this->mark();
+    const auto pending = m_pending;
+    if (!skip()) {
+      return false;
+    }
+    Node<JSON> node;
+    if (pending) {
+      // The element of a typed container lacks its marker
+      std::string value(1, pending);
+      value.append(mark.base.cur, m_cur);
+      node.j = json::from_ubjson(value, true, false);
+    } else {
+      node.j = json::from_ubjson(mark.base.cur, m_cur, true, false);
+    }
+    const auto end = this->mark();
+    reset_to(mark);
+    if (node.j.is_discarded() || !unpack_node(node, v)) {
+      return fail("Bad value");
+    }
+    reset_to(end);
+    return true;
+  }
+
+private:
+  struct Level {
+    std::size_t size;
+    bool sized;
+    char type;
+    char end;
+  };
+
+  bool need(std::size_t n) {
+    return remaining() >= n || fail("Unexpected end of input");
+  }
+
+  bool advance(std::size_t n) {
+    if (!need(n)) {
+      return false;
+    }
+    m_cur += n;
+    return true;
+  }
+
+  bool at(char c) {
+    skip_noop();
+    return m_cur != m_end && *m_cur == c;
+  }
+
+  void skip_noop() {
+    while (m_cur != m_end && *m_cur == 'N') {
+      ++m_cur;
+    }
+  }
+
+  /// Restore the position without clearing the error
+  void reset_to(Mark mark) {
+    m_cur = mark.base.cur;
+    m_pending = mark.pending;
+  }
+
+  bool peek_marker(char &marker) {
+    if (m_pending) {
+      marker = m_pending;
+      return true;
+    }
+    skip_noop();
+    if (m_cur == m_end) {
+      return false;
+    }
+    marker = *m_cur;
+    return true;
+  }
+
+  bool take_marker(char &marker) {
+    if (!peek_marker(marker)) {
+      return fail("Unexpected end of input");
+    }
+    if (m_pending) {
+      m_pending = 0;
+    } else {
+      ++m_cur;
+    }
+    return true;
+  }
+
+  bool read_int(char marker, StreamInteger &n) {
+    switch (marker) {
+    case 'i':
+      return load_signed<std::uint8_t, std::int8_t>(n);
+    case 'U':
+      return load_unsigned<std::uint8_t>(n);
+    case 'I':
+      return load_signed<std::uint16_t, std::int16_t>(n);
+    case 'l':
+      return load_signed<std::uint32_t, std::int32_t>(n);
+    case 'L':
+      return load_signed<std::uint64_t, std::int64_t>(n);
+    default:
+      return false;
+    }
+  }
+
+  template <typename U> bool load_unsigned(StreamInteger &n) {
+    if (!need(sizeof(U))) {
+      return false;
+    }
+    n = StreamInteger{internal::load_be<U>(m_cur), false};
+    m_cur += sizeof(U);
+    return true;
+  }
+
+  template <typename U, typename S> bool load_signed(StreamInteger &n) {
+    if (!need(sizeof(U))) {
+      return false;
+    }
+    const auto s =
+        static_cast<std::int64_t>(static_cast<S>(internal::load_be<U>(m_cur)));
+    n = StreamInteger{static_cast<std::uint64_t>(s), s < 0};
+    m_cur += sizeof(U);
+    return true;
+  }
+
+  /// Read a length with its own marker
+  bool read_length(std::size_t &n) {
+    char marker;
+    StreamInteger len;
+    if (!take_marker(marker) || !read_int(marker, len) || len.negative) {
+      return fail("Bad length");
+    }
+    n = len.bits;
+    return true;
+  }
+
+  /// Read the length and the bytes of a string in place
+  bool read_sized(std::string_view &v) {
+    std::size_t n;
+    if (!read_length(n) || !need(n)) {
+      return false;
+    }
+    v = std::string_view(m_cur, n);
+    m_cur += n;
+    return true;
+  }
+
+  static bool typed_array_of_marker(char marker,
+                                    internal::TypedArray &type) {
+    type = internal::TypedArray{false, true, false, 1};
+    switch (marker) {
+    case 'U':
+      type.is_signed = false;
+      return true;
+    case 'i':
+      return true;
+    case 'I':
+      type.size = 2;
+      return true;
+    case 'l':
+      type.size = 4;
+      return true;
+    case 'L':
+      type.size = 8;
+      return true;
+    case 'd':
+      type = internal::TypedArray{true, true, false, 4};
+      return true;
+    case 'D':
+      type = internal::TypedArray{true, true, false, 8};
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  /// Read the optional type and count after the container marker
+  bool read_container(StreamFrame &frame) {
+    frame = StreamFrame{};
+    if (m_cur != m_end && *m_cur == '$') {
+      if (!need(2)) {
+        return false;
+      }
+      frame.type = m_cur[1];
+      m_cur += 2;
+      if (m_cur == m_end || *m_cur != '#') {
+        return fail("Expected count");
+      }
+    }
+    if (m_cur != m_end && *m_cur == '#') {
+      ++m_cur;
+      frame.sized = true;
+      if (!read_length(frame.size)) {
+        return false;
+      }
+      // Elements of these types take no bytes, so the count alone could make
+      // us build or skip any number of them; allow about one per byte left,
+      // as for the other types, but keep short ones at the end of the input
+      const auto t = frame.type;
+      if ((t == 'Z' || t == 'T' || t == 'F' || t == 'N') &&
+          frame.size > std::max<std::size_t>(remaining(), 4096)) {
+        return fail("Bad count");
+      }
+    }
+    return true;
+  }
+
+  bool begin(StreamFrame &frame, char open) {
+    const auto mark = this->mark();
+    char marker;
+    if (!take_marker(marker)) {
+      return false;
+    }
+    if (marker != open) {
+      reset_to(mark);
+      return fail(open == '[' ? "Expected array" : "Expected object");
+    }
+    return read_container(frame);
+  }
+
+  bool next(StreamFrame &frame, char close) {
+    if (frame.sized) {
+      if (frame.size == 0) {
+        return false;
+      }
+      --frame.size;
+    } else {
+      skip_noop();
+      if (!need(1)) {
+        return false;
+      }
+      if (*m_cur == close) {
+        ++m_cur;
+        return false;
+      }
+    }
+    m_pending = frame.type;
+    return true;
+  }
+
+  char m_pending = 0;
+  std::vector<Level> m_stack;
+};
+
+/// Writer emitting UBJSON straight from objects
+///
+/// Containers are written with their count.
+class UbjsonWriter : public StreamWriter {
+public:
+  using StreamWriter::StreamWriter;
+
+  void write_null() { m_out += 'Z'; }
+
+  void write_bool(bool v) { m_out += v ? 'T' : 'F'; }
+
+  template <typename I> void write_integer(I v) {
+    if constexpr (std::is_signed_v<I>) {
+      write_int(static_cast<std::int64_t>(v));
+    } else if (v <= static_cast<std::uint64_t>(
+                         std::numeric_limits<std::int64_t>::max())) {
+      write_int(static_cast<std::int64_t>(v));
+    } else {
+      // High precision number
+      char buf[24];
+      const auto res = std::to_chars(buf, buf + sizeof(buf), v);
+      m_out += 'H';
+      write_length(res.ptr - buf);
+      m_out.append(buf, res.ptr);
+    }
+  }
+
+  template <typename F> void write_float(F v) {
+    if constexpr (std::is_same_v<F, float>) {
+      m_out += 'd';
+      internal::store_be(m_out, internal::bit_cast<std::uint32_t>(v));
+    } else {
+      m_out += 'D';
+      internal::store_be(m_out, internal::bit_cast<std::uint64_t>(
+                                    static_cast<double>(v)));
+    }
+  }
+
+  void write_string(std::string_view v) {
+    m_out += 'S';
+    write_key(v);
+  }
+
+  void begin_array(std::size_t n) {
+    m_out += "[#";
+    write_length(n);
+  }
+
+  void end_array() {}
+
+  void begin_object(std::size_t n) {
+    m_out += "{#";
+    write_length(n);
+  }
+
+  void write_key(std::string_view key) {
+    write_length(key.size());
+    m_out.append(key.data(), key.size());
+  }
+
+  void write_encoded_key(std::string_view bytes) { m_out += bytes; }
+
+  void write_key_id(std::size_t id) {
+    char buf[24];
+    const auto res = std::to_chars(buf, buf + sizeof(buf), id);
+    write_key(std::string_view(buf, res.ptr - buf));
+  }
+
+  void end_object() {}
+
+  /// Array with the type of the elements, which are copied at once and put in
+  /// big-endian order
+  template <typename T> bool write_bulk(const T *data, std::size_t n) {
+    char marker;
+    if constexpr (std::is_same_v<T, float>) {
+      marker = 'd';
+    } else if constexpr (std::is_same_v<T, double>) {
+      marker = 'D';
+    } else if constexpr (sizeof(T) == 1) {
+      marker = std::is_signed_v<T> ? 'i' : 'U';
+    } else if constexpr (!std::is_signed_v<T>) {
+      // No unsigned types but the byte
+      return false;
+    } else {
+      marker = sizeof(T) == 2 ? 'I' : sizeof(T) == 4 ? 'l' : 'L';
+    }
+    m_out += "[$";
+    m_out += marker;
+    m_out += '#';
+    write_length(n);
+    const auto size = m_out.size();
+    m_out.append(reinterpret_cast<const char *>(data), n * sizeof(T));
+    if (internal::little_endian()) {
+      internal::byteswap_all<sizeof(T)>(&m_out[size], n);
+    }
+    return true;
+  }
+
+  /// Encode a value of a type without stream support through the json tree
+  template <typename T> void fallback(const T &v) {
+    try {
+      const json j = v;
+      json::to_ubjson(j, m_out);
+    } catch (std::exception &e) {
+      fail_copy("Bad value", e.what());
+    }
+  }
+
+private:
+  void write_int(std::int64_t v) {
+    if (v >= std::numeric_limits<std::int8_t>::min() &&
+        v <= std::numeric_limits<std::int8_t>::max()) {
+      m_out += 'i';
+      m_out += static_cast<char>(v);
+    } else if (v >= 0 && v <= std::numeric_limits<std::uint8_t>::max()) {
+      m_out += 'U';
+      m_out += static_cast<char>(v);
+    } else if (v >= std::numeric_limits<std::int16_t>::min() &&
+               v <= std::numeric_limits<std::int16_t>::max()) {
+      m_out += 'I';
+      internal::store_be(m_out, static_cast<std::uint16_t>(v));
+    } else if (v >= std::numeric_limits<std::int32_t>::min() &&
+               v <= std::numeric_limits<std::int32_t>::max()) {
+      m_out += 'l';
+      internal::store_be(m_out, static_cast<std::uint32_t>(v));
+    } else {
+      m_out += 'L';
+      internal::store_be(m_out, static_cast<std::uint64_t>(v));
+    }
+  }
+
+  void write_length(std::size_t n) {
+    if (n >
+        static_cast<std::size_t>(std::numeric_limits<std::int64_t>::max())) {
+      fail("Too large");
+      return;
+    }
+    write_int(static_cast<std::int64_t>(n));
+  }
+};
+
 template <> struct LangHandler<UBJSON> {
+  using Reader = UbjsonReader;
+  using Writer = UbjsonWriter;
+
   static Node<UBJSON> from_string(const std::string &str) {
-    return Node<UBJSON>{json::from_ubjson(str)};
+    return from_bytes(str);
+  }
+
+  static Node<UBJSON> from_bytes(std::string_view bytes) {
+    return Node<UBJSON>{json::from_ubjson(bytes.begin(), bytes.end())};
   }
 
   static std::string to_string(const Node<UBJSON> &node) {
-    auto vec = nlohmann::json::to_ubjson(node.j);
-    return std::string(vec.begin(), vec.end());
+    std::string str;
+    json::to_ubjson(node.j, str);
+    return str;
   }
 
   template <typename T> static T unpack(const Node<UBJSON> &node) {
-    auto jnode = Node<JSON>{node.j};
-    return LangHandler<JSON>::template unpack<T>(jnode);
+    return node.j.get<T>();
   }
 
   template <typename T> static Node<UBJSON> pack(const T &obj) {
@@ -30,12 +761,22 @@ template <> struct LangHandler<UBJSON> {
 
   template <typename T, typename... Args>
   static T unpack_struct(const Node<UBJSON> &node, Member<Args>... args) {
-    auto jnode = Node<JSON>{node.j};
-    return LangHandler<JSON>::template unpack_struct<T>(jnode, args...);
+    return LangHandler<JSON>::template unpack_object<T>(node.j, args...);
+  }
+
+  template <typename T>
+  static bool try_unpack(const Node<UBJSON> &node, T &obj, Error &err) {
+    return LangHandler<JSON>::try_unpack_value(node.j, obj, err);
+  }
+
+  template <typename T>
+  static bool try_unpack_struct(const Node<UBJSON> &node, T &obj,
+                                Error &err) {
+    return LangHandler<JSON>::try_unpack_object(node.j, obj, err);
   }
 
   template <typename T, typename... Args>
-  static Node<UBJSON> pack_struct(Member<Args>... args) {
+  static Node<UBJSON> pack_struct(MemberRef<const Args>... args) {
     return Node<UBJSON>{LangHandler<JSON>::template pack_struct<T>(args...).j};
   }
 };
@@ -10,18 +10,69 @@
 
 #include <yaml-cpp/yaml.h>
 
+namespace yamlcpp = ::YAML;
+
 namespace serde {
 struct YAML;
-} // namespace serde
 
-namespace yamlcpp = ::YAML;
+template <> struct Node<YAML> { yamlcpp::Node node; };
+} // namespace serde
 
 namespace serde::yaml::internal {
 
+/// View of a yaml-cpp node for serde::internal::probe
+///
+/// Nodes are handles, so elements are held by value.
+struct Probe {
+  yamlcpp::Node node;
+
+  bool is_null() const { return node.IsNull(); }
+
+  template <typename T> bool is() const {
+    T tmp;
+    return node.IsScalar() && yamlcpp::convert<T>::decode(node, tmp);
+  }
+
+  bool string(std::string_view &s) const {
+    if (!node.IsScalar()) {
+      return false;
+    }
+    s = node.Scalar();
+    return true;
+  }
+
+  bool is_array() const { return node.IsSequence(); }
+  std::size_t size() const { return node.size(); }
+  Probe at(std::size_t i) const { return Probe{node[i]}; }
+
+  template <typename F> bool all_elements(F f) const {
+    for (const auto &e : node) {
+      if (!f(Probe{e})) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool is_object() const { return node.IsMap(); }
+
+  template <typename F> bool all_members(F f) const {
+    for (const auto &kv : node) {
+      if (kv.first.IsScalar() &&
+          !f(std::string_view(kv.first.Scalar()), Probe{kv.second})) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
 /// Helper method for std::variant converter
+///
+/// Alternatives the probe rules out are skipped without throwing.
 template <typename T, typename U>
 void try_set(const yamlcpp::Node &node, U &rhs, bool &set) {
-  if (set) {
+  if (set || !serde::internal::probe<T>(Probe{node})) {
     return;
   }
   try {
@@ -98,21 +149,70 @@ template <typename K, typename V> struct convert<std::unordered_map<K, V>> {
 
 /// Converter for std::variant
 template <typename... T> struct convert<std::variant<T...>> {
-  static bool decode(const Node &node, std::variant<T...> &rhs) {
-    bool set = false;
+  using V = std::variant<T...>;
+
+  static bool decode(const Node &node, V &rhs) {
+    if constexpr (serde::internal::is_tagged_variant<V>::value) {
+      return decode_tagged(node, rhs);
+    } else {
+      bool set = false;
 
-    (serde::yaml::internal::try_set<T>(node, rhs, set), ...);
+      (serde::yaml::internal::try_set<T>(node, rhs, set), ...);
 
-    return set;
+      return set;
+    }
   }
 
-  static Node encode(const std::variant<T...> &rhs) {
+  static Node encode(const V &rhs) {
     Node node;
 
     std::visit([&](auto &v) { node = Node(v); }, rhs);
 
+    if constexpr (serde::internal::is_tagged_variant<V>::value) {
+      using Tags = serde::VariantTags<V>;
+      const auto name = std::string(Tags::names.name(rhs.index()));
+      if (Tags::tag.empty()) {
+        Node outer(NodeType::Map);
+        outer.force_insert(name, node);
+        return outer;
+      }
+      node[std::string(Tags::tag)] = name;
+    }
+
     return node;
   }
+
+private:
+  static bool decode_tagged(const Node &node, V &rhs) {
+    using Tags = serde::VariantTags<V>;
+    if (!node.IsMap()) {
+      return false;
+    }
+    Node value = node;
+    std::string name;
+    if (Tags::tag.empty()) {
+      if (node.size() != 1) {
+        return false;
+      }
+      const auto kv = *node.begin();
+      name = kv.first.Scalar();
+      value = kv.second;
+    } else {
+      const auto tag = node[std::string(Tags::tag)];
+      if (!tag || !tag.IsScalar()) {
+        return false;
+      }
+      name = tag.Scalar();
+      // The tag isn't a member of the alternative
+      value = Clone(node);
+      value.remove(std::string(Tags::tag));
+    }
+    return serde::internal::with_alternative(
+        rhs, Tags::names.find(name), [&](auto &alt) {
+          alt = value.template as<std::decay_t<decltype(alt)>>();
+          return true;
+        });
+  }
 };
 
 /// Converter for std::optional
@@ -170,13 +270,17 @@ template <typename T> struct convert {
 
 namespace serde {
 
-template <> struct Node<YAML> { yamlcpp::Node node; };
-
 template <> struct LangHandler<YAML> {
   static Node<YAML> from_string(const std::string &str) {
     return Node<YAML>{yamlcpp::Load(str)};
   }
 
+  static Node<YAML> from_bytes(std::string_view bytes) {
+    internal::ViewStreamBuf buf(bytes);
+    std::istream is(&buf);
+    return Node<YAML>{yamlcpp::Load(is)};
+  }
+
   static std::string to_string(const Node<YAML> &node) {
     yamlcpp::Emitter e;
     e << node.node;
@@ -197,33 +301,151 @@ template <> struct LangHandler<YAML> {
       throw yamlcpp::TypedBadConversion<T>(node.node.Mark());
     }
 
-    auto unpack_member = [&](const auto &mem) {
-      if (node.node[mem.name]) {
-        return node.node[mem.name]
-            .template as<std::decay_t<decltype(mem.value.value())>>();
+    // Match each key of the input to its member once
+    std::array<std::optional<yamlcpp::Node>, sizeof...(Args)> slots;
+    for (auto it = node.node.begin(); it != node.node.end(); ++it) {
+      if (!it->first.IsScalar()) {
+        continue;
+      }
+      const auto i = internal::field_index_v<T>.find(it->first.Scalar());
+      if (i < slots.size()) {
+        slots[i] = it->second;
+      } else if (DenyUnknown<T>::value) {
+        throw Exception("Unknown member: " + it->first.Scalar());
+      }
+    }
+
+    return unpack_slots<T>(node, slots, std::index_sequence_for<Args...>{},
+                           args...);
+  }
+
+  template <typename T, std::size_t... I, typename... Args>
+  static T unpack_slots(
+      const Node<YAML> &node,
+      const std::array<std::optional<yamlcpp::Node>, sizeof...(Args)> &slots,
+      std::index_sequence<I...>, Member<Args>... args) {
+    // Values and defaults are built in place of the members
+    auto unpack_member = [&](const auto &v, auto &mem) {
+      if (v) {
+        return v->template as<typename std::decay_t<decltype(mem)>::type>();
       } else {
-        if (mem.value) {
-          return mem.value.value();
+        if (mem.make_default) {
+          return mem.make_default();
         } else {
           throw yamlcpp::KeyNotFound(node.node.Mark(), std::string(mem.name));
         }
       }
     };
 
-    return T{unpack_member(args)...};
+    return T{unpack_member(slots[I], args)...};
+  }
+
+  template <typename T>
+  static bool try_unpack(const Node<YAML> &node, T &obj, Error &err) {
+    return try_unpack_value(node.node, obj, err);
+  }
+
+  template <typename T>
+  static bool try_unpack_struct(const Node<YAML> &node, T &obj, Error &err) {
+    return try_unpack_map(node.node, obj, err);
+  }
+
+  /// Decode a value without throwing for malformed input
+  ///
+  /// Structures, enums and optionals are matched here; other types are
+  /// probed first so that yaml-cpp only sees values it can convert.
+  template <typename T>
+  static bool try_unpack_value(const yamlcpp::Node &node, T &obj, Error &err) {
+    if constexpr (is_serde_record_v<T>) {
+      return try_unpack_map(node, obj, err);
+    } else if constexpr (std::is_enum_v<T> && is_serde_specialized_v<T>) {
+      if (!node.IsScalar()) {
+        return err.fail("Enum value is not scalar");
+      }
+      const auto value = internal::enum_table_v<T>.value(node.Scalar());
+      if (!value) {
+        return err.fail_copy("Bad enum value", node.Scalar());
+      }
+      obj = value.value();
+      return true;
+    } else if constexpr (internal::is_optional<T>::value) {
+      if (node.IsNull()) {
+        obj.reset();
+        return true;
+      }
+      if constexpr (std::is_default_constructible_v<typename T::value_type>) {
+        return try_unpack_value(node, obj.emplace(), err);
+      } else {
+        return try_convert(node, obj, err);
+      }
+    } else {
+      return try_convert(node, obj, err);
+    }
+  }
+
+  /// Convert through yaml-cpp if the probe doesn't rule the node out
+  template <typename T>
+  static bool try_convert(const yamlcpp::Node &node, T &obj, Error &err) {
+    if (!internal::probe<T>(yaml::internal::Probe{node})) {
+      return err.fail("Unexpected node type");
+    }
+    try {
+      obj = node.as<T>();
+      return true;
+    } catch (std::exception &e) {
+      return err.fail_copy("Bad value", e.what());
+    }
+  }
+
+  /// Decode a structure in place without throwing
+  template <typename T>
+  static bool try_unpack_map(const yamlcpp::Node &node, T &obj, Error &err) {
+    if (!node.IsMap()) {
+      return err.fail("Node is not map");
+    }
+
+    auto members = CoreHandler<T>::fields(obj);
+    std::array<std::optional<yamlcpp::Node>,
+               std::tuple_size_v<decltype(members)>>
+        slots;
+    for (auto it = node.begin(); it != node.end(); ++it) {
+      if (!it->first.IsScalar()) {
+        continue;
+      }
+      const auto i = internal::field_index_v<T>.find(it->first.Scalar());
+      if (i < slots.size()) {
+        slots[i] = it->second;
+      } else if (DenyUnknown<T>::value) {
+        return err.fail_copy("Unknown member", it->first.Scalar());
+      }
+    }
+
+    return !internal::any_member(members, [&](auto &mem, auto i) {
+      if (slots[i]) {
+        if (try_unpack_value(*slots[i], mem.value, err)) {
+          return false;
+        }
+        // Name the innermost member that failed
+        if (err.detail().empty()) {
+          err.set(err.reason(), err.offset(), mem.name);
+        }
+        return true;
+      }
+      if constexpr (std::decay_t<decltype(mem)>::has_default) {
+        mem.value = mem.make_default();
+        return false;
+      } else {
+        return !err.fail("Node member doesn't have value", mem.name);
+      }
+    });
   }
 
   template <typename T, typename... Args>
-  static Node<YAML> pack_struct(Member<Args>... args) {
+  static Node<YAML> pack_struct(MemberRef<const Args>... args) {
     yamlcpp::Node node(yamlcpp::NodeType::Map);
 
     auto push_member = [&](auto &mem) {
-      if (!mem.value) {
-        // TODO: Throw logic error
-        throw yamlcpp::KeyNotFound(node.Mark(), std::string(mem.name));
-      }
-
-      node.force_insert(mem.name, mem.value.value());
+      node.force_insert(mem.name, mem.value);
     };
 
     (push_member(args), ...);
@@ -0,0 +1,974 @@
+#include <gtest/gtest.h>
+
+#define SERDE_TYPED_ARRAYS 1
+#include <serde/serde_all.h>
+
+enum class Level {
+  Low,
+  High,
+};
+
+SERDE_ADD_ENUM(Level, Low, High)
+
+struct Point {
+  int x;
+  int y;
+};
+
+SERDE_ADD_STRUCT(Point, x, y)
+
+inline bool operator==(const Point &lhs, const Point &rhs) {
+  return lhs.x == rhs.x && lhs.y == rhs.y;
+}
+
+struct Ping {
+  int seq;
+
+  SERDE_DEFINE(seq)
+};
+
+struct Text {
+  std::string body;
+
+  SERDE_DEFINE(body)
+};
+
+using Message = std::variant<Ping, Text>;
+using Event = std::variant<Point, Ping>;
+
+SERDE_ADD_VARIANT(Message, "ping", "text")
+SERDE_ADD_VARIANT_TAG(Event, "type", "point", "ping")
+
+struct Record {
+  std::string name;
+  int count;
+  std::vector<double> values;
+  std::optional<Point> point;
+  Level level;
+  std::map<int, std::string> labels;
+
+  SERDE_DEFINE(name, SERDE_OPT(count, 42), values, point, level, labels)
+};
+
+/// Projection of Record
+struct RecordName {
+  std::string name;
+
+  SERDE_DEFINE(name)
+};
+
+/// Number of defaults built by make_history
+int built_defaults = 0;
+
+std::vector<int> make_history() {
+  ++built_defaults;
+  return {1, 2, 3};
+}
+
+struct Account {
+  std::string id;
+  std::vector<int> history;
+
+  SERDE_DEFINE(id, SERDE_OPT(history, make_history()))
+};
+
+struct Tick {
+  std::string symbol;
+  double price;
+  int size;
+
+  SERDE_DEFINE(symbol, price, SERDE_OPT(size, 1))
+};
+
+/// Later version of Tick
+struct TickV2 {
+  std::string venue;
+  std::string symbol;
+  double price;
+
+  SERDE_DEFINE(SERDE_OPT(venue, "none"), symbol, price)
+};
+
+SERDE_ADD_IDS(Tick, 1, 2, 5)
+SERDE_ADD_IDS(TickV2, 7, 1, 2)
+SERDE_ADD_POSITIONAL_IDS(Account)
+
+struct Config {
+  std::string host;
+  int port;
+
+  SERDE_DEFINE(host, SERDE_OPT(port, 80))
+};
+
+SERDE_DENY_UNKNOWN(Config)
+
+using Setting = std::variant<Config, Ping>;
+
+SERDE_ADD_VARIANT_TAG(Setting, "type", "config", "ping")
+
+TEST(Stream, Json) {
+  auto r = serde::from_string<serde::JSON, Record>(
+      R"({"name": "a\"bé😀", "unknown": {"x": [1, {"y": "]"}]},
+          "values": [1, 2.5, -3e2], "point": {"x": 1, "y": 2},
+          "level": "High", "labels": [[1, "one"]]})");
+  ASSERT_TRUE(bool(r)) << r.error();
+
+  EXPECT_EQ(r.value().name, "a\"b\xc3\xa9\xf0\x9f\x98\x80");
+  EXPECT_EQ(r.value().count, 42);
+  EXPECT_EQ(r.value().values, (std::vector<double>{1, 2.5, -300}));
+  EXPECT_EQ(r.value().point, (Point{1, 2}));
+  EXPECT_EQ(r.value().level, Level::High);
+  EXPECT_EQ(r.value().labels, (std::map<int, std::string>{{1, "one"}}));
+}
+
+TEST(Stream, JsonError) {
+  EXPECT_FALSE(bool(serde::from_string<serde::JSON, Record>(
+      R"({"name": "a", "values": [1,], "point": null, "level": "Low",
+          "labels": []})")));
+  EXPECT_FALSE(bool(serde::from_string<serde::JSON, Record>(
+      R"({"name": "a", "values": [], "level": "Low", "labels": []})")));
+  EXPECT_FALSE(bool(serde::from_string<serde::JSON, Record>(
+      R"({"name": "a", "values": [], "point": null, "level": "Low",
+          "labels": []} x)")));
+
+  // Numbers follow the grammar of JSON
+  for (const char *bad : {"007", "1.", "-", "1e", "1e+", ".5", "+1", "1.5.2"}) {
+    EXPECT_FALSE((serde::from_string<serde::JSON, double>(bad))) << bad;
+    EXPECT_FALSE((serde::from_string<serde::JSON, int>(bad))) << bad;
+  }
+  EXPECT_EQ((serde::from_string<serde::JSON, double>("-0.5e-1").value()),
+            -0.05);
+  EXPECT_EQ((serde::from_string<serde::JSON, int>("0").value()), 0);
+
+  // Integers written with a point or an exponent are taken if whole
+  EXPECT_EQ((serde::from_string<serde::JSON, int>("1.0").value()), 1);
+  EXPECT_EQ((serde::from_string<serde::JSON, long>("-2e3").value()), -2000);
+  EXPECT_FALSE((serde::from_string<serde::JSON, int>("1.5")));
+  EXPECT_FALSE((serde::from_string<serde::JSON, unsigned>("-1.0")));
+  EXPECT_FALSE((serde::from_string<serde::JSON, std::int8_t>("128.0")));
+}
+
+TEST(Stream, TryUnpack) {
+  const auto node = serde::Core::from_string<serde::JSON>(
+      R"({"name": "a", "values": [1], "point": null, "level": "Middle",
+          "labels": []})");
+  Record r;
+  serde::Error err;
+  EXPECT_FALSE(serde::Core::try_unpack(node, r, err));
+  EXPECT_EQ(std::string_view(err.reason()), "Bad enum value");
+  EXPECT_EQ(err.detail(), "Middle");
+
+  const auto good = serde::Core::from_string<serde::YAML>(
+      "name: a\nvalues: [1, 2]\nlevel: High\nlabels: {}\npoint: {x: 1, y: 2}");
+  err.clear();
+  ASSERT_TRUE(serde::Core::try_unpack(good, r, err)) << err.message();
+  EXPECT_EQ(r.count, 42);
+  EXPECT_EQ(r.point, (Point{1, 2}));
+  EXPECT_EQ(r.level, Level::High);
+
+  // Errors carry the reason and the member, and are formatted on request
+  auto y = serde::from_string<serde::YAML, Record>(
+      "name: a\nvalues: [x]\npoint: ~\nlevel: Low\nlabels: {}");
+  ASSERT_FALSE(bool(y));
+  EXPECT_EQ(std::string_view(y.cause().reason()), "Unexpected node type");
+  EXPECT_EQ(y.cause().detail(), "values");
+  EXPECT_EQ(y.error(),
+            "serde: on parsing string: Unexpected node type: values");
+
+  auto j = serde::from_string<serde::JSON, Record>(R"({"name": 1})");
+  ASSERT_FALSE(bool(j));
+  EXPECT_EQ(j.cause().offset(), 9u);
+}
+
+inline bool operator==(const Record &lhs, const Record &rhs) {
+  return lhs.name == rhs.name && lhs.count == rhs.count &&
+         lhs.values == rhs.values && lhs.point == rhs.point &&
+         lhs.level == rhs.level && lhs.labels == rhs.labels;
+}
+
+TEST(Stream, JsonBuffer) {
+  auto r =
+      Record{"tab\t\"quote\"\x01", 7, {0.5, 2}, {}, Level::Low, {{3, "c"}}};
+
+  std::string buf = "prefix";
+  auto size = serde::to_buffer<serde::JSON>(r, buf);
+  ASSERT_TRUE(bool(size)) << size.error();
+  EXPECT_EQ(buf.size(), 6 + size.value());
+  EXPECT_EQ(buf.substr(6),
+            R"({"name":"tab\t\"quote\"\u0001","count":7,"values":[0.5,2.0],)"
+            R"("point":null,"level":"Low","labels":[[3,"c"]]})");
+
+  auto dat = serde::from_string<serde::JSON, Record>(buf.substr(6));
+  ASSERT_TRUE(bool(dat)) << dat.error();
+  EXPECT_EQ(r, dat.value());
+}
+
+template <typename Lang> void check_binary(const std::string &dom) {
+  auto r = Record{"bin", -70000, {0.5, 1e300}, Point{-1, 300}, Level::High,
+                  {{-5, "x"}, {1 << 20, "y"}}};
+
+  auto bytes = serde::to_string<Lang>(r);
+  ASSERT_TRUE(bool(bytes)) << bytes.error();
+  auto dat = serde::from_string<Lang, Record>(bytes.value());
+  ASSERT_TRUE(bool(dat)) << dat.error();
+  EXPECT_EQ(r, dat.value());
+
+  // Bytes from another encoder
+  auto other = serde::from_string<Lang, Record>(dom);
+  ASSERT_TRUE(bool(other)) << other.error();
+  EXPECT_EQ(r, other.value());
+
+  EXPECT_FALSE(bool(serde::from_string<Lang, Record>(
+      bytes.value().substr(0, bytes.value().size() - 1))));
+}
+
+TEST(Stream, Binary) {
+  const auto j = nlohmann::json::parse(
+      R"({"name": "bin", "count": -70000, "values": [0.5, 1e300],
+          "extra": [{"a": [1, 2.5, "s", null, true]}],
+          "point": {"x": -1, "y": 300}, "level": "High",
+          "labels": [[-5, "x"], [1048576, "y"]]})");
+
+  std::string cbor, msgpack, ubjson;
+  nlohmann::json::to_cbor(j, cbor);
+  nlohmann::json::to_msgpack(j, msgpack);
+  nlohmann::json::to_ubjson(j, ubjson, true, true);
+
+  check_binary<serde::CBOR>(cbor);
+  check_binary<serde::MsgPack>(msgpack);
+  check_binary<serde::UBJSON>(ubjson);
+
+  // Elements taking no bytes are bounded by the input left
+  const std::string nulls{"[$Z#L\0\0\0\0\x10\0\0\0", 13};
+  auto many =
+      serde::from_string<serde::UBJSON, std::vector<std::optional<int>>>(nulls);
+  ASSERT_FALSE(bool(many));
+  EXPECT_EQ(many.error(), "serde: on parsing string: Bad count (at offset 13)");
+  EXPECT_FALSE(bool(serde::from_string<serde::UBJSON, Ping>(
+      "{#U\x01U\x01x" + nulls)));
+  auto few = serde::from_string<serde::UBJSON, std::vector<std::optional<int>>>(
+      "[$Z#U\x03");
+  ASSERT_TRUE(bool(few)) << few.error();
+  EXPECT_EQ(few.value().size(), 3u);
+}
+
+struct View {
+  std::string_view name;
+  std::vector<std::string_view> tags;
+
+  SERDE_DEFINE(name, tags)
+};
+
+TEST(Stream, Borrow) {
+  const std::string json = R"({"name": "abc", "tags": ["x", "yz"]})";
+  auto r = serde::from_bytes<serde::JSON, View>(json);
+  ASSERT_TRUE(bool(r)) << r.error();
+  EXPECT_EQ(r.value().name, "abc");
+  EXPECT_EQ(r.value().name.data(), json.data() + 10);
+  EXPECT_EQ(r.value().tags, (std::vector<std::string_view>{"x", "yz"}));
+
+  EXPECT_FALSE(bool(serde::from_bytes<serde::JSON, View>(
+      R"({"name": "a\nb", "tags": []})")));
+
+  auto bytes = serde::to_string<serde::MsgPack>(r.value());
+  ASSERT_TRUE(bool(bytes)) << bytes.error();
+  std::vector<std::byte> buf(bytes.value().size());
+  std::memcpy(buf.data(), bytes.value().data(), buf.size());
+  auto m = serde::from_bytes<serde::MsgPack, View>(buf);
+  ASSERT_TRUE(bool(m)) << m.error();
+  EXPECT_EQ(m.value().name, "abc");
+  EXPECT_EQ(m.value().tags, r.value().tags);
+
+  auto p =
+      serde::from_bytes<serde::YAML, Point>(std::string_view("{x: 1, y: 2}"));
+  ASSERT_TRUE(bool(p)) << p.error();
+  EXPECT_EQ(p.value(), (Point{1, 2}));
+}
+
+TEST(Stream, File) {
+  auto r = Record{"file", 1, {2.5}, Point{3, 4}, Level::Low, {}};
+  const std::string path = ::testing::TempDir() + "serde-stream-file.cbor";
+
+  auto bytes = serde::to_string<serde::CBOR>(r);
+  ASSERT_TRUE(bool(bytes)) << bytes.error();
+  std::ofstream(path, std::ios::binary) << bytes.value();
+
+  auto dat = serde::from_file<serde::CBOR, Record>(path);
+  ASSERT_TRUE(bool(dat)) << dat.error();
+  EXPECT_EQ(r, dat.value());
+
+  EXPECT_FALSE(bool(serde::from_file<serde::CBOR, Record>(path + ".none")));
+
+  // Types that would borrow from the unmapped file are rejected
+  static_assert(!serde::internal::borrows<Record>::value);
+  static_assert(serde::internal::borrows<View>::value);
+  static_assert(
+      serde::internal::borrows<std::map<int, std::optional<View>>>::value);
+}
+
+TEST(Stream, Sink) {
+  auto p = Point{5, -6};
+
+  std::vector<std::byte> bytes(1);
+  auto size = serde::to_buffer<serde::MsgPack>(p, bytes);
+  ASSERT_TRUE(bool(size)) << size.error();
+  EXPECT_EQ(bytes.size(), 1 + size.value());
+  auto dat = serde::from_bytes<serde::MsgPack, Point>(bytes.data() + 1,
+                                                      size.value());
+  ASSERT_TRUE(bool(dat)) << dat.error();
+  EXPECT_EQ(dat.value(), p);
+
+  std::ostringstream os;
+  ASSERT_TRUE(bool(serde::to_stream<serde::JSON>(p, os)));
+  ASSERT_TRUE(bool(serde::to_stream<serde::YAML>(p, os << '\n')));
+  EXPECT_EQ(os.str(), "{\"x\":5,\"y\":-6}\nx: 5\ny: -6");
+
+  const std::string path = ::testing::TempDir() + "serde-stream-sink.json";
+  ASSERT_TRUE(bool(serde::to_file<serde::JSON>(p, path)));
+  auto file = serde::from_file<serde::JSON, Point>(path);
+  ASSERT_TRUE(bool(file)) << file.error();
+  EXPECT_EQ(file.value(), p);
+}
+
+TEST(Stream, FieldIndex) {
+  constexpr auto index = serde::make_field_index("name", "count", "values");
+  static_assert(index.find("count") == 1);
+  static_assert(index.find("value") == index.size());
+  EXPECT_EQ(index.find("values"), 2u);
+
+  // Node based languages match keys through the same index
+  auto r = serde::from_string<serde::YAML, Record>(
+      "labels: {}\nlevel: Low\nextra: 1\npoint: {y: 2, x: 1}\nvalues: []\n"
+      "name: y");
+  ASSERT_TRUE(bool(r)) << r.error();
+  EXPECT_EQ(r.value().name, "y");
+  EXPECT_EQ(r.value().count, 42);
+  EXPECT_EQ(r.value().point, (Point{1, 2}));
+
+  EXPECT_FALSE(bool(serde::from_string<serde::YAML, Record>(
+      "labels: {}\nlevel: Low\nvalues: []\nname: y")));
+}
+
+TEST(Stream, Enum) {
+  auto l = serde::from_string<serde::JSON, std::vector<Level>>(
+      R"(["High", "Low", "Low"])");
+  ASSERT_TRUE(bool(l)) << l.error();
+  EXPECT_EQ(l.value(),
+            (std::vector<Level>{Level::High, Level::Low, Level::Low}));
+
+  EXPECT_FALSE(bool(serde::from_string<serde::JSON, Level>(R"("Middle")")));
+  EXPECT_FALSE(bool(serde::to_string<serde::JSON>(static_cast<Level>(7))));
+  EXPECT_FALSE(bool(serde::to_string<serde::YAML>(static_cast<Level>(7))));
+
+  auto s = serde::to_string<serde::YAML>(Level::High);
+  ASSERT_TRUE(bool(s)) << s.error();
+  EXPECT_EQ(s.value(), "High");
+}
+
+TEST(Stream, Variant) {
+  const std::vector<Message> msgs{Ping{3}, Text{"hi"}};
+  auto m = serde::to_string<serde::JSON>(msgs);
+  ASSERT_TRUE(bool(m)) << m.error();
+  EXPECT_EQ(m.value(), R"([{"ping":{"seq":3}},{"text":{"body":"hi"}}])");
+
+  auto y = serde::to_string<serde::YAML>(msgs);
+  ASSERT_TRUE(bool(y)) << y.error();
+  for (const auto &s : {m.value(), y.value()}) {
+    auto r = s == m.value()
+                 ? serde::from_string<serde::JSON, std::vector<Message>>(s)
+                 : serde::from_string<serde::YAML, std::vector<Message>>(s);
+    ASSERT_TRUE(bool(r)) << r.error();
+    ASSERT_EQ(r.value().size(), 2u);
+    EXPECT_EQ(std::get<Ping>(r.value()[0]).seq, 3);
+    EXPECT_EQ(std::get<Text>(r.value()[1]).body, "hi");
+  }
+  EXPECT_FALSE(bool(
+      serde::from_string<serde::JSON, Message>(R"({"pong": {"seq": 1}})")));
+
+  const Event ev = Ping{5};
+  auto e = serde::to_string<serde::JSON>(ev);
+  ASSERT_TRUE(bool(e)) << e.error();
+  EXPECT_EQ(e.value(), R"({"type":"ping","seq":5})");
+
+  auto p = serde::from_string<serde::JSON, Event>(
+      R"({"x": 1, "y": 2, "type": "point"})");
+  ASSERT_TRUE(bool(p)) << p.error();
+  EXPECT_EQ(std::get<Point>(p.value()), (Point{1, 2}));
+
+  auto d = serde::from_string<serde::YAML, Event>("type: ping\nseq: 7");
+  ASSERT_TRUE(bool(d)) << d.error();
+  EXPECT_EQ(std::get<Ping>(d.value()).seq, 7);
+
+  // Untagged alternatives are probed before decoding
+  using Value = std::variant<int, std::string, std::vector<int>, Point>;
+  auto u = serde::from_string<serde::JSON, std::vector<Value>>(
+      R"([1, "a", [2], {"x": 3, "y": 4}])");
+  ASSERT_TRUE(bool(u)) << u.error();
+  EXPECT_EQ(std::get<std::string>(u.value()[1]), "a");
+  EXPECT_EQ(std::get<Point>(u.value()[3]), (Point{3, 4}));
+
+  auto n = serde::Core::from_string<serde::YAML>("[1, a, [2], {x: 3, y: 4}]");
+  auto v = serde::Core::unpack<serde::YAML, std::vector<Value>>(n);
+  EXPECT_EQ(std::get<std::vector<int>>(v[2]), std::vector<int>{2});
+  EXPECT_EQ(std::get<Point>(v[3]), (Point{3, 4}));
+}
+
+struct Arena {
+  std::pmr::string name;
+  std::pmr::vector<std::pmr::string> tags;
+  std::pmr::map<std::pmr::string, std::pmr::vector<int>> groups;
+  std::pmr::string note;
+
+  SERDE_DEFINE(name, tags, groups, SERDE_OPT(note, "none"))
+};
+
+TEST(Stream, Arena) {
+  std::array<std::byte, 4096> buf;
+  std::pmr::monotonic_buffer_resource arena(buf.data(), buf.size(),
+                                            std::pmr::null_memory_resource());
+  const auto on_arena = [&](const auto &c) {
+    return c.get_allocator().resource() == &arena;
+  };
+
+  auto r = serde::from_string<serde::JSON, Arena>(
+      R"({"name": "a long name that doesn't fit in place",
+          "tags": ["first tag out of place", "esc\"aped tag out of place"],
+          "groups": {"group with a long name": [1, 2, 3]}})",
+      &arena);
+  ASSERT_TRUE(bool(r)) << r.error();
+  const auto &a = r.value();
+  EXPECT_TRUE(on_arena(a.name));
+  EXPECT_TRUE(on_arena(a.tags));
+  EXPECT_TRUE(on_arena(a.groups));
+  EXPECT_TRUE(on_arena(a.note));
+  ASSERT_EQ(a.tags.size(), 2u);
+  EXPECT_TRUE(on_arena(a.tags[1]));
+  EXPECT_EQ(a.tags[1], "esc\"aped tag out of place");
+  ASSERT_EQ(a.groups.size(), 1u);
+  EXPECT_TRUE(on_arena(a.groups.begin()->first));
+  EXPECT_TRUE(on_arena(a.groups.begin()->second));
+  EXPECT_EQ(a.note, "none");
+
+  auto bytes = serde::to_string<serde::CBOR>(a);
+  ASSERT_TRUE(bool(bytes)) << bytes.error();
+  auto c = serde::from_bytes<serde::CBOR, Arena>(bytes.value(), &arena);
+  ASSERT_TRUE(bool(c)) << c.error();
+  EXPECT_TRUE(on_arena(c.value().tags[0]));
+  EXPECT_EQ(c.value().groups.begin()->second, (std::pmr::vector<int>{1, 2, 3}));
+}
+
+TEST(Stream, Records) {
+  // Records reuse the object, so its vector keeps its capacity
+  std::vector<Point> points;
+  std::vector<const int *> storage;
+  auto n = serde::records_from_bytes<serde::JSON, std::vector<int>>(
+      "[1, 2]\n[3]\n\n[4, 5, 6]\n", [&](std::vector<int> &v) {
+        points.push_back(Point{int(v.size()), v.back()});
+        storage.push_back(v.data());
+      });
+  ASSERT_TRUE(bool(n)) << n.error();
+  EXPECT_EQ(n.value(), 3u);
+  EXPECT_EQ(points, (std::vector<Point>{{2, 2}, {1, 3}, {3, 6}}));
+  EXPECT_EQ(storage[0], storage[1]);
+
+  std::string bytes;
+  for (const auto &p : points) {
+    ASSERT_TRUE(bool(serde::to_buffer<serde::MsgPack>(p, bytes)));
+  }
+  serde::RecordReader<serde::MsgPack, Point> records(bytes);
+  std::vector<Point> decoded(records.begin(), records.end());
+  EXPECT_FALSE(records.failed());
+  EXPECT_EQ(decoded, points);
+
+  // Each frame holds exactly one value
+  std::string framed;
+  for (const auto &p : points) {
+    auto body = serde::to_string<serde::CBOR>(p);
+    ASSERT_TRUE(bool(body)) << body.error();
+    framed += std::string{0, 0, 0, char(body.value().size())} + body.value();
+  }
+  std::size_t count = 0;
+  auto f = serde::records_from_bytes<serde::CBOR, Point>(
+      framed, [&](Point &) { return ++count < 2; },
+      serde::Framing::LengthPrefixed);
+  ASSERT_TRUE(bool(f)) << f.error();
+  EXPECT_EQ(f.value(), 2u);
+
+  framed.pop_back();
+  auto t = serde::records_from_bytes<serde::CBOR, Point>(
+      framed, [](Point &) {}, serde::Framing::LengthPrefixed);
+  ASSERT_FALSE(bool(t));
+  EXPECT_EQ(std::string_view(t.cause().reason()), "Truncated record");
+
+  auto e = serde::records_from_bytes<serde::JSON, Point>(
+      R"({"x": 1, "y": 2} {"x": 1})", [](Point &) {});
+  ASSERT_FALSE(bool(e));
+  EXPECT_NE(e.error().find("serde: on parsing records"), std::string::npos);
+}
+
+TEST(Stream, Parallel) {
+  std::vector<Point> points;
+  for (int i = 0; i < 1000; ++i) {
+    points.push_back(Point{i, -i});
+  }
+  serde::ParallelOptions options;
+  options.threads = 4;
+  options.min_chunk = 64;
+
+  auto check = [&](auto *lang) {
+    using Lang = std::remove_pointer_t<decltype(lang)>;
+    auto bytes = serde::to_string<Lang>(points);
+    ASSERT_TRUE(bool(bytes)) << bytes.error();
+    auto v = serde::parallel_from_bytes<Lang, Point>(bytes.value(), options);
+    ASSERT_TRUE(bool(v)) << v.error();
+    EXPECT_EQ(v.value(), points);
+  };
+  check((serde::JSON *)nullptr);
+  check((serde::MsgPack *)nullptr);
+  check((serde::CBOR *)nullptr);
+  check((serde::UBJSON *)nullptr);
+
+  std::string lines;
+  std::string framed;
+  for (const auto &p : points) {
+    lines += serde::to_string<serde::JSON>(p).value() + "\n";
+    auto body = serde::to_string<serde::MsgPack>(p).value();
+    framed += std::string{0, 0, 0, char(body.size())} + body;
+  }
+  auto r = serde::parallel_records_from_bytes<serde::JSON, Point>(
+      lines, serde::Framing::Concatenated, options);
+  ASSERT_TRUE(bool(r)) << r.error();
+  EXPECT_EQ(r.value(), points);
+  auto f = serde::parallel_records_from_bytes<serde::MsgPack, Point>(
+      framed, serde::Framing::LengthPrefixed, options);
+  ASSERT_TRUE(bool(f)) << f.error();
+  EXPECT_EQ(f.value(), points);
+
+  // The first error of the input is reported, at its offset in the input
+  auto bad = lines;
+  bad.replace(bad.find("\"x\":900,"), 7, "\"x\":\"9\"");
+  bad.replace(bad.find("\"x\":990,"), 7, "\"x\":\"9\"");
+  auto e = serde::parallel_records_from_bytes<serde::JSON, Point>(
+      bad, serde::Framing::Concatenated, options);
+  ASSERT_FALSE(bool(e));
+  EXPECT_EQ(e.cause().offset(), bad.find("\"9\""));
+  EXPECT_NE(e.error().find("serde: on parsing records"), std::string::npos);
+
+  auto s = serde::parallel_from_bytes<serde::JSON, Point>("[{\"x\": 1}, ]",
+                                                         options);
+  ASSERT_FALSE(bool(s));
+  EXPECT_NE(s.error().find("serde: on parsing bytes"), std::string::npos);
+}
+
+TEST(Stream, JsonScan) {
+  using String = serde::Result<std::string>;
+  const auto parse = [](const std::string &str) {
+    return serde::from_string<serde::JSON, std::string>(str);
+  };
+
+  // Every position of the special bytes, in and past the vector blocks
+  for (std::size_t i = 0; i < 80; ++i) {
+    const std::string head(i, 'a');
+    const std::string tail(80 - i, 'b');
+    String r = parse('"' + head + "\\\"" + tail + '"');
+    ASSERT_TRUE(bool(r)) << r.error();
+    EXPECT_EQ(r.value(), head + '"' + tail);
+    r = parse('"' + head + "\\u00e9" + tail + '"');
+    ASSERT_TRUE(bool(r)) << r.error();
+    EXPECT_EQ(r.value(), head + "\xc3\xa9" + tail);
+    r = parse('"' + head + "\xc3\xa9" + tail + '"');
+    ASSERT_TRUE(bool(r)) << r.error();
+    EXPECT_EQ(r.value(), head + "\xc3\xa9" + tail);
+
+    // Clean runs are copied around the escapes whatever their length
+    const auto text =
+        serde::to_string<serde::JSON>(head + "\"\\\n\x01" + tail);
+    ASSERT_TRUE(bool(text)) << text.error();
+    EXPECT_EQ(text.value(), '"' + head + "\\\"\\\\\\n\\u0001" + tail + '"');
+
+    // Invalid UTF-8 is reported at its first byte
+    r = parse('"' + head + "\xc3(" + tail + '"');
+    ASSERT_FALSE(bool(r));
+    EXPECT_EQ(r.cause().offset(), i + 1);
+    EXPECT_STREQ(r.cause().reason(), "Invalid UTF-8 in string");
+    const auto written = serde::to_string<serde::JSON>(head + "\xc3(" + tail);
+    ASSERT_FALSE(bool(written));
+    EXPECT_EQ(written.cause().offset(), i + 1);
+    EXPECT_STREQ(written.cause().reason(), "Invalid UTF-8 in string");
+  }
+  EXPECT_FALSE(bool(serde::to_string<serde::JSON>(std::string("\xff"))));
+  for (const char *bad : {"\"\xc0\xaf\"", "\"\xed\xa0\x80\"",
+                          "\"\xf4\x90\x80\x80\"", "\"\xe2\x82\"", "\"\x80\""}) {
+    EXPECT_FALSE(bool(parse(bad))) << bad;
+  }
+  EXPECT_TRUE(bool(parse("\"\xf0\x9f\x98\x80\"")));
+
+  // Indentation and skipped members with brackets inside strings
+  auto p = serde::from_string<serde::JSON, Point>(
+      "{\n" + std::string(40, ' ') + "\"extra\": [\"" + std::string(100, '{') +
+      "\\\"]\", {\"a\": \"}\"}],\n" + std::string(40, '\t') +
+      "\"x\": 1, \"y\": 2\n}");
+  ASSERT_TRUE(bool(p)) << p.error();
+  EXPECT_EQ(p.value(), (Point{1, 2}));
+}
+
+TEST(Stream, TypedArrays) {
+  const std::vector<float> samples{1.5f, -2.25f, 1e30f, 0.0f};
+
+  // UBJSON declares the type of the elements, which any decoder reads
+  auto u = serde::to_string<serde::UBJSON>(samples);
+  ASSERT_TRUE(bool(u)) << u.error();
+  EXPECT_EQ(u.value().substr(0, 4), "[$d#");
+  EXPECT_EQ(serde::json::from_ubjson(u.value()).get<std::vector<float>>(),
+            samples);
+  auto back = serde::from_string<serde::UBJSON, std::vector<double>>(u.value());
+  ASSERT_TRUE(bool(back)) << back.error();
+  EXPECT_EQ(back.value(), std::vector<double>(samples.begin(), samples.end()));
+
+  // Each way round for every binary format
+  auto check = [&](auto *lang) {
+    using Lang = std::remove_pointer_t<decltype(lang)>;
+    const std::array<std::int16_t, 3> shorts{-1, 300, -32768};
+    const std::vector<std::uint64_t> empty;
+    auto s = serde::to_string<Lang>(samples);
+    auto a = serde::to_string<Lang>(shorts);
+    auto e = serde::to_string<Lang>(empty);
+    ASSERT_TRUE(s && a && e);
+    EXPECT_EQ(
+        (serde::from_string<Lang, std::vector<float>>(s.value()).value()),
+        samples);
+    EXPECT_EQ((serde::from_string<Lang, std::array<std::int16_t, 3>>(a.value())
+                   .value()),
+              shorts);
+    EXPECT_EQ((serde::from_string<Lang, std::vector<int>>(a.value()).value()),
+              (std::vector<int>{-1, 300, -32768}));
+    EXPECT_TRUE(
+        (serde::from_string<Lang, std::vector<std::uint64_t>>(e.value())
+             .value()
+             .empty()));
+
+    // Elements are converted like single values
+    auto n = serde::from_string<Lang, std::vector<std::uint8_t>>(a.value());
+    ASSERT_FALSE(bool(n));
+    EXPECT_FALSE(
+        bool(serde::from_string<Lang, std::vector<int>>(s.value())));
+    EXPECT_FALSE(
+        bool(serde::from_string<Lang, std::array<float, 3>>(s.value())));
+
+    // Through values that look at the type first
+    using Maybe = std::optional<std::vector<float>>;
+    using Either = std::variant<int, std::vector<float>>;
+    EXPECT_EQ((serde::from_string<Lang, Maybe>(s.value()).value()),
+              Maybe(samples));
+    EXPECT_EQ((serde::from_string<Lang, Either>(s.value()).value()),
+              Either(samples));
+    const auto rec =
+        serde::to_string<Lang>(Record{"r", 1, {0.5, 2}, {}, Level::Low, {}});
+    EXPECT_EQ((serde::LazyView<Lang>(rec.value())["values"]
+                   .template as<std::vector<double>>()
+                   .value()),
+              (std::vector<double>{0.5, 2}));
+  };
+  check((serde::CBOR *)nullptr);
+  check((serde::MsgPack *)nullptr);
+  check((serde::UBJSON *)nullptr);
+
+  // Big-endian typed array of CBOR: tag 81, then a byte string
+  const std::string be{"\xd8\x51\x48\x3f\xc0\x00\x00\xc0\x10\x00\x00", 11};
+  auto c = serde::from_string<serde::CBOR, std::vector<float>>(be);
+  ASSERT_TRUE(bool(c)) << c.error();
+  EXPECT_EQ(c.value(), (std::vector<float>{1.5f, -2.25f}));
+
+  // Tags in front of numbers are skipped whether they are floats or not
+  const std::string tagged{"\x82\xd8\x64\xf9\x3e\x00\xd8\x64\x02", 9};
+  auto d = serde::from_string<serde::CBOR, std::vector<double>>(tagged);
+  ASSERT_TRUE(bool(d)) << d.error();
+  EXPECT_EQ(d.value(), (std::vector<double>{1.5, 2}));
+}
+
+TEST(Stream, Lazy) {
+  const std::string doc = R"({"name": "r", "values": [1, 2.5, 3],
+    "point": {"x": 1, "y": 2}, "level": "High", "labels": {},
+    "name": "last"})";
+  serde::LazyView<serde::JSON> view(doc);
+  EXPECT_EQ(view.type(), serde::StreamToken::Object);
+  EXPECT_EQ(view.size(), 6u);
+  EXPECT_EQ(view.key(5), "name");
+
+  // The last of repeated members wins, as when decoding the whole
+  EXPECT_EQ(view.get<std::string>("name").value(), "last");
+  EXPECT_EQ(view["point"].as<Point>().value(), (Point{1, 2}));
+  EXPECT_EQ(view["point"].bytes(), R"({"x": 1, "y": 2})");
+  EXPECT_EQ(view["values"][1].as<double>().value(), 2.5);
+  EXPECT_EQ(view["values"].size(), 3u);
+
+  // Errors of lookups carry over to the values and keep their offsets
+  auto missing = view["point"]["z"]["w"].as<int>();
+  ASSERT_FALSE(bool(missing));
+  EXPECT_EQ(missing.error(),
+            "serde: on parsing view: Node member doesn't have value: z (at "
+            "offset " +
+                std::to_string(doc.find("{\"x\"")) + ")");
+  auto type = view["level"].as<int>();
+  ASSERT_FALSE(bool(type));
+  EXPECT_EQ(type.cause().offset(), doc.find("\"High\""));
+  EXPECT_FALSE(bool(view["values"][3]));
+  EXPECT_FALSE(bool(view["name"]["x"]));
+  serde::LazyView<serde::JSON> bad(R"({"a": "x, "b": 1})");
+  EXPECT_FALSE(bool(bad["b"]));
+  EXPECT_EQ(bad.size(), 0u);
+
+  // Binary formats are looked into the same way
+  const auto rec = Record{"bin", 1, {}, Point{3, 4}, Level::Low, {}};
+  const auto bytes = serde::to_string<serde::MsgPack>(rec).value();
+  serde::LazyView<serde::MsgPack> packed(bytes);
+  EXPECT_EQ(packed.get<std::string>("name").value(), "bin");
+  EXPECT_EQ(packed["point"].get<int>("y").value(), 4);
+  EXPECT_EQ(packed.as<Record>().value().point, rec.point);
+}
+
+TEST(Stream, Projection) {
+  const std::string doc = R"({"name": "r", "count": 3, "values": [1, 2],
+    "point": {"x": 1, "y": 2}, "level": "High", "labels": {"1": "a"}})";
+  const serde::Projection<Record> columns{"count", "level"};
+  auto r = serde::from_bytes<serde::JSON>(doc, columns);
+  ASSERT_TRUE(bool(r)) << r.error();
+  EXPECT_EQ(r.value().count, 3);
+  EXPECT_EQ(r.value().level, Level::High);
+  EXPECT_TRUE(r.value().name.empty());
+  EXPECT_TRUE(r.value().values.empty());
+  EXPECT_FALSE(r.value().point);
+
+  // Members projected still have to be there, the others don't
+  auto missing = serde::from_bytes<serde::JSON>(
+      std::string(R"({"name": "r", "values": []})"), columns);
+  ASSERT_FALSE(bool(missing));
+  EXPECT_EQ(missing.error(), "serde: on parsing bytes: Node member doesn't "
+                             "have value: level (at offset 27)");
+  EXPECT_EQ(serde::from_bytes<serde::JSON>(
+                doc, serde::Projection<Record>{"count", "size"})
+                .error(),
+            "serde: on parsing bytes: Unknown member: size (at offset 0)");
+
+  // Binary records skip the members left out by their lengths
+  std::string bytes;
+  for (int i = 0; i < 3; ++i) {
+    const auto rec = Record{"bin", i, {0.5}, Point{i, i}, Level::Low, {}};
+    bytes += serde::to_string<serde::MsgPack>(rec).value();
+  }
+  const serde::Projection<Record> point{"point"};
+  serde::RecordReader<serde::MsgPack, Record> records(bytes, point);
+  int sum = 0;
+  for (auto &rec : records) {
+    EXPECT_TRUE(rec.name.empty());
+    sum += rec.point->y;
+  }
+  EXPECT_FALSE(records.failed()) << records.error().message();
+  EXPECT_EQ(sum, 3);
+
+  // A structure with some of the members is a projection as well
+  const auto one = Record{"one", 1, {0.5}, {}, Level::Low, {}};
+  auto name = serde::from_string<serde::MsgPack, RecordName>(
+      serde::to_string<serde::MsgPack>(one).value());
+  ASSERT_TRUE(bool(name)) << name.error();
+  EXPECT_EQ(name.value().name, "one");
+}
+
+TEST(Stream, Into) {
+  auto rec = Record{std::string(100, 'n'), 1, {1, 2, 3, 4}, {}, Level::Low,
+                    {{1, "a"}}};
+  const auto *name = rec.name.data();
+  const auto *values = rec.values.data();
+
+  // Shorter strings and arrays are decoded into the memory already held
+  auto r = serde::from_string_into<serde::JSON>(
+      R"({"name": "short", "values": [5, 6], "point": null, "level": "High",
+          "labels": []})",
+      rec);
+  ASSERT_TRUE(bool(r)) << r.error();
+  EXPECT_EQ(rec.name, "short");
+  EXPECT_EQ(rec.name.data(), name);
+  EXPECT_EQ(rec.values, (std::vector<double>{5, 6}));
+  EXPECT_EQ(rec.values.data(), values);
+  EXPECT_EQ(rec.count, 42);
+  EXPECT_TRUE(rec.labels.empty());
+
+  // Elements are read over in place, keeping their strings
+  std::vector<Text> texts{{std::string(100, 'a')}, {std::string(100, 'b')}};
+  const auto *body = texts[1].body.data();
+  const auto bytes = serde::to_string<serde::MsgPack>(
+                         std::vector<Text>{{"x"}, {"y"}, {"z"}})
+                         .value();
+  ASSERT_TRUE(bool(serde::from_bytes_into<serde::MsgPack>(bytes, texts)));
+  ASSERT_EQ(texts.size(), 3u);
+  EXPECT_EQ(texts[1].body, "y");
+  EXPECT_EQ(texts[1].body.data(), body);
+  ASSERT_TRUE(bool(serde::from_string_into<serde::JSON>(
+      std::string(R"([{"body": "only"}])"), texts)));
+  EXPECT_EQ(texts.size(), 1u);
+
+  auto bad = serde::from_string_into<serde::JSON>(std::string("[1]"), texts);
+  ASSERT_FALSE(bool(bad));
+  EXPECT_EQ(bad.error(),
+            "serde: on parsing string: Expected object (at offset 1)");
+}
+
+TEST(Stream, Defaults) {
+  // Node based unpacking builds defaults for missing members only; other
+  // tests may have built some already
+  const int before = built_defaults;
+  const auto given = serde::Core::from_bytes<serde::JSON>(
+      R"({"id": "a", "history": [4]})");
+  EXPECT_EQ((serde::Core::unpack<serde::JSON, Account>(given).history),
+            std::vector<int>{4});
+  EXPECT_EQ(built_defaults, before);
+  const auto missing = serde::Core::from_bytes<serde::JSON>(R"({"id": "a"})");
+  EXPECT_EQ((serde::Core::unpack<serde::JSON, Account>(missing).history),
+            (std::vector<int>{1, 2, 3}));
+  EXPECT_EQ(built_defaults, before + 1);
+}
+
+TEST(Stream, EncodedKeys) {
+  // Keys are copied from their encoding, made once per writer and type
+  EXPECT_EQ(serde::to_string<serde::MsgPack>(Point{1, 2}).value(),
+            std::string("\x82\xa1x\x01\xa1y\x02"));
+  EXPECT_EQ(serde::to_string<serde::CBOR>(Point{1, 2}).value(),
+            std::string("\xa2\x61x\x01\x61y\x02"));
+  EXPECT_EQ(serde::to_string<serde::UBJSON>(Point{1, 2}).value(),
+            std::string("{#i\x02i\x01xi\x01i\x01yi\x02"));
+  EXPECT_EQ(serde::to_string<serde::JSON>(
+                std::vector<Event>{Point{1, 2}, Ping{3}})
+                .value(),
+            R"([{"type":"point","x":1,"y":2},{"type":"ping","seq":3}])");
+}
+
+template <typename Lang> void check_ids() {
+  const auto v2 = serde::to_string<Lang>(TickV2{"X", "AB", 2.5}).value();
+  auto tick = serde::from_string<Lang, Tick>(v2);
+  ASSERT_TRUE(bool(tick)) << tick.error();
+  EXPECT_EQ(tick.value().symbol, "AB");
+  EXPECT_EQ(tick.value().size, 1);
+  auto back = serde::from_string<Lang, TickV2>(
+      serde::to_string<Lang>(tick.value()).value());
+  ASSERT_TRUE(bool(back)) << back.error();
+  EXPECT_EQ(back.value().venue, "none");
+  EXPECT_EQ(back.value().price, 2.5);
+}
+
+TEST(Stream, MemberIds) {
+  // Binary formats key the members by id, text formats by name
+  EXPECT_EQ(serde::to_string<serde::MsgPack>(Tick{"A", 0.5, 3}).value(),
+            std::string("\x83\x01\xa1"
+                        "A\x02\xcb\x3f\xe0\0\0\0\0\0\0\x05\x03",
+                        16));
+  EXPECT_EQ(serde::to_string<serde::JSON>(Tick{"A", 0.5, 3}).value(),
+            R"({"symbol":"A","price":0.5,"size":3})");
+  // The tree of Core::pack keeps the key order of nlohmann::json
+  EXPECT_EQ(serde::Core::pack<serde::JSON>(Tick{"A", 0.5, 3}).j.dump(),
+            R"({"price":0.5,"size":3,"symbol":"A"})");
+  const auto account = serde::to_string<serde::CBOR>(Account{"a", {1}});
+  EXPECT_EQ(account.value().substr(0, 5), std::string("\xa2\x00\x61"
+                                                      "a\x01",
+                                                      5));
+  auto decoded = serde::from_string<serde::CBOR, Account>(account.value());
+  ASSERT_TRUE(bool(decoded)) << decoded.error();
+  EXPECT_EQ(decoded.value().history, std::vector<int>{1});
+
+  // Unknown ids are skipped and missing ones take their defaults
+  check_ids<serde::MsgPack>();
+  check_ids<serde::CBOR>();
+  check_ids<serde::UBJSON>();
+
+  // Members keyed by name are still read
+  std::string named;
+  nlohmann::json::to_msgpack(
+      nlohmann::json::parse(R"({"price": 1.5, "symbol": "N", "7": 1})"),
+      named);
+  auto tick = serde::from_string<serde::MsgPack, Tick>(named);
+  ASSERT_TRUE(bool(tick)) << tick.error();
+  EXPECT_EQ(tick.value().symbol, "N");
+  EXPECT_EQ(tick.value().price, 1.5);
+
+  // Integer keys that can't be ids match no member
+  const std::string negative("\x83\xff\x05\x01\xa1"
+                             "A\x02\xcb\x3f\xe0\0\0\0\0\0\0",
+                             16);
+  tick = serde::from_string<serde::MsgPack, Tick>(negative);
+  ASSERT_TRUE(bool(tick)) << tick.error();
+  EXPECT_EQ(tick.value().symbol, "A");
+  EXPECT_EQ(tick.value().size, 1);
+  const std::string huge("\xa3\x3b\xff\xff\xff\xff\xff\xff\xff\xff\x05"
+                         "\x01\x61"
+                         "A\x02\xfb\x3f\xe0\0\0\0\0\0\0",
+                         24);
+  tick = serde::from_string<serde::CBOR, Tick>(huge);
+  ASSERT_TRUE(bool(tick)) << tick.error();
+  EXPECT_EQ(tick.value().price, 0.5);
+}
+
+TEST(Stream, Unknown) {
+  // Unknown members are skipped without decoding but must be well formed
+  auto rec = serde::from_string<serde::JSON, Record>(
+      R"({"name": "a", "new": {"b": [1, {"c": "}"}]}, "values": [],
+          "level": "Low", "labels": [], "point": null})");
+  ASSERT_TRUE(bool(rec)) << rec.error();
+  const std::string mismatched =
+      R"({"name": "a", "new": {"b": [1, 2}}, "values": []})";
+  rec = serde::from_string<serde::JSON, Record>(mismatched);
+  ASSERT_FALSE(bool(rec));
+  EXPECT_EQ(rec.error(), "serde: on parsing string: Mismatched bracket (at "
+                         "offset " +
+                             std::to_string(mismatched.find("}")) + ")");
+  const auto with_new = [](const std::string &value) {
+    return R"({"name": "a", "new": )" + value +
+           R"(, "values": [], "level": "Low", "labels": [], "point": null})";
+  };
+  ASSERT_TRUE(bool(serde::from_string<serde::JSON, Record>(
+      with_new(R"({"a": [1, -2e3, {}, "\u00e9\"\n"], "b": {"c": []}})"))));
+  for (const char *bad :
+       {"1-2e", "[1,,,]", R"({"a" "b" : :})", "[1 2]", R"({"a": 1,})",
+        "[tru]", "{,}", "[1]]", "\"\x01\"", "\"\xff\"", R"(["\q"])",
+        "{\"\xff\": 1}"}) {
+    EXPECT_FALSE(bool(serde::from_string<serde::JSON, Record>(with_new(bad))))
+        << bad;
+  }
+
+  // Structures denying unknown members name the first one
+  const std::string doc = R"({"host": "h", "prot": 8080})";
+  auto config = serde::from_string<serde::JSON, Config>(doc);
+  ASSERT_FALSE(bool(config));
+  EXPECT_EQ(config.error(), "serde: on parsing string: Unknown member: prot "
+                            "(at offset " +
+                                std::to_string(doc.find(" 8080")) + ")");
+  std::string packed;
+  nlohmann::json::to_msgpack(nlohmann::json::parse(doc), packed);
+  const auto error = [](auto r) { return r.error(); };
+  EXPECT_EQ(error(serde::from_string<serde::MsgPack, Config>(packed)),
+            "serde: on parsing string: Unknown member: prot (at offset 13)");
+  EXPECT_EQ(error(serde::from_string<serde::YAML, Config>("{host: h, x: 1}")),
+            "serde: on parsing string: Unknown member: x");
+  config = serde::from_string<serde::JSON, Config>(R"({"host": "h"})");
+  ASSERT_TRUE(bool(config)) << config.error();
+  EXPECT_EQ(config.value().port, 80);
+
+  // The tag of a variant isn't an unknown member of its alternative
+  const auto check_tagged = [](auto *lang) {
+    using Lang = std::remove_pointer_t<decltype(lang)>;
+    const auto text = serde::to_string<Lang>(Setting{Config{"h", 8}});
+    ASSERT_TRUE(bool(text)) << text.error();
+    const auto setting = serde::from_string<Lang, Setting>(text.value());
+    ASSERT_TRUE(bool(setting)) << setting.error();
+    ASSERT_EQ(setting.value().index(), 0u);
+    EXPECT_EQ(std::get<Config>(setting.value()).port, 8);
+  };
+  check_tagged((serde::JSON *)nullptr);
+  check_tagged((serde::MsgPack *)nullptr);
+  check_tagged((serde::YAML *)nullptr);
+  const auto tree = serde::Core::from_bytes<serde::JSON>(
+      R"({"port": 8, "type": "config", "host": "h"})");
+  EXPECT_EQ(std::get<Config>(serde::Core::unpack<serde::JSON, Setting>(tree))
+                .port,
+            8);
+  EXPECT_FALSE(bool(serde::from_string<serde::JSON, Setting>(
+      R"({"type": "config", "host": "h", "kind": 1})")));
+}